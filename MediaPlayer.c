@@ -30,6 +30,185 @@
  * its leading "!" and sent to the controller. The idea is to allow the person 
  * at the keyboard to directly issue commands to the controller.
  * 
+ * Besides the clips, the controller can have MediaPlayer play short sound 
+ * effects over whatever clip is showing (the !sfx command). Each sound effect 
+ * is a 16-bit PCM .wav file whose samples are read into memory at startup. 
+ * VLC has no part in playing them: each effect keeps its own handle on the 
+ * ALSA device AUDIO_DEVICE open (link with -lasound) and has a thread of its 
+ * own that writes the samples to it. The controller thread just wakes that 
+ * thread, so neither it nor main loop ever waits on the sound card. An !sfx 
+ * for an effect that's still playing starts it again from the beginning. The 
+ * latency reported for each effect is from the !sfx command to its first 
+ * samples reaching the device.
+ * 
+ * Normally VLC puts the video on the screen itself, and a switch from one clip 
+ * to the next is a hard cut. If COMPOSITOR is defined, MediaPlayer instead 
+ * uses two media players ("decks") that decode into memory through libVLC's 
+ * video callbacks. Each new clip starts on the deck that isn't in use and the 
+ * compositor crossfades from the old deck's last frame to the new deck's 
+ * frames, writing the result directly to the Linux framebuffer (FB_DEVICE). 
+ * The blend is done by blendRow(), which uses NEON on the Pi (build with 
+ * -mfpu=neon), SSE2 or AVX2 on x86 and plain C otherwise. The keyboard command 
+ * "blendbench" reports how long a full-screen blend takes compared to the 
+ * time available per frame.
+ * 
+ * A clip may have several renditions (see mediadef.h). Each time a clip is 
+ * started, chooseRendition() picks one based on the fraction of frames that 
+ * were dropped recently, the CPU load and the Pi's temperature and throttling 
+ * state as reported in sysfs. The sysfs files read can be changed with the 
+ * environment variables MP_THERMAL_PATH and MP_THROTTLE_PATH, e.g., to point 
+ * them at ordinary files for testing. The choice is logged, and the 
+ * "renditions" command shows how many frames were dropped in each rendition.
+ * 
+ * The controller can also have a clip "scrubbed" -- shown paused at a 
+ * position set by a dial the visitor turns -- with the !scrub command. Dial 
+ * readings often arrive faster than VLC can seek, so main loop only issues a 
+ * seek when the previous one has shown up (or after FRAME_RATE allows 
+ * another frame) and always seeks to the latest reading, dropping the ones in 
+ * between. A seek is done once VLC reports a position nearer the reading 
+ * than the one it left. Readings past SCRUB_LAST_POS are taken as 
+ * SCRUB_LAST_POS, since seeking to the very end would end the clip; should a 
+ * seek end it anyway, it's started again, held and sought back. When 
+ * SCRUB_IDLE_MS pass without a reading, the scrub is over and things carry 
+ * on as if the scrubbed clip had finished playing.
+ * 
+ * VLC's own log messages don't go to stderr. They go into a ring buffer that 
+ * holds the most recent VLCLOG_ENTRIES of them, so there's a history to look 
+ * at after something goes wrong without the cost of writing to the console 
+ * as the video plays. Messages below a minimum level, which can be set per 
+ * VLC module, are ignored, and at most VLCLOG_RATE are kept per second. The 
+ * "vlclog" command shows the ring's contents and sets the levels.
+ * 
+ * For figuring out what happened when, MediaPlayer also keeps a trace: a ring 
+ * of the last TRACE_ENTRIES commands, controller messages, main loop state 
+ * changes and libVLC player events, each with a nanosecond timestamp and the 
+ * id of the thread involved. The "trace" command, or a SIGUSR1, writes the 
+ * trace to a file in Chrome trace format, which can be loaded into 
+ * chrome://tracing or ui.perfetto.dev to see it on a timeline.
+ * 
+ * Most of the time the exhibit is just showing a loop, so what MediaPlayer 
+ * costs when it's idle matters. The "powerbench" command measures it: over a 
+ * fixed period it counts, from /proc, each thread's wakeups (voluntary 
+ * context switches), involuntary context switches and CPU time, along with 
+ * the process's resident memory, and checks them against limits for the mode 
+ * the player is in (waiting for the controller, looping or playing a clip). 
+ * Run from the shell as "MediaPlayer powerbench [<secs>]", MediaPlayer starts 
+ * up without the controller link and plays the controller's part itself: it 
+ * measures each mode in turn -- waiting, looping BENCH_LOOP_ID and playing 
+ * BENCH_CLIP_ID -- then exits, with a non-zero status if any mode failed, so 
+ * the check can be scripted.
+ * 
+ * When MediaPlayer misbehaves on the exhibit, where there's no perf to 
+ * attach, the "profile <secs>" command, or a SIGUSR2 (PROFILE_SECS), runs a 
+ * sampling profiler. An ITIMER_PROF timer sends SIGPROF at PROFILE_HZ per 
+ * second of the process's CPU time, which lands on whichever thread, ours or 
+ * libVLC's, is using the CPU; the handler just records that thread's stack. 
+ * At the end, the stacks are written to a file (PROFILE_PATH by default) in 
+ * the "folded" format flamegraph.pl and speedscope read. Runs are limited to 
+ * PROFILE_MAX_SECS and PROFILE_SAMPLES samples, and the time spent in the 
+ * handler is reported, so it's safe to do briefly on a live exhibit; what 
+ * that time comes to depends on the machine, so check it on the Pi itself. 
+ * Stacks need the -funwind-tables the build tasks compile with (on the Pi's 
+ * 32-bit ARM, backtrace() can't get past a function without them) and 
+ * function names need their -rdynamic; functions in libVLC's plugins that 
+ * aren't exported show as the library they're in.
+ * 
+ * So that slow decline -- an ageing SD card, a Pi that's getting too hot -- 
+ * shows up, MediaPlayer keeps a history that survives restarts: for every 
+ * clip switch, how long the clip took to start playing and to show its first 
+ * frame, the fraction of its frames dropped and how long the controller took 
+ * to respond to the !videoEnds it was sent. These are rolled up by the hour 
+ * (for HISTORY_HOURS) and by the day (for HISTORY_DAYS), as histograms so 
+ * percentiles can be had, in a fixed-size file, HISTORY_PATH, that's mapped 
+ * into memory. The "history" command, or running "MediaPlayer history ..." 
+ * from the shell, even while the exhibit is running, shows trends by the hour 
+ * or day, compares percentiles between the latest days and the ones before, 
+ * or breaks the numbers down by clip.
+ * 
+ * Main loop is a state machine. Everything that can affect what's on the 
+ * screen -- commands, libVLC player events, timers -- arrives as an event in 
+ * a queue, and main loop sleeps until there is one. What it does about an 
+ * event, and the state it then moves to, is looked up in the table 
+ * transitions[state][event]. How a clip can be interrupted is set per clip in 
+ * mediadef.h: fullPlay clips can't be; others can be given a time after they 
+ * start during which they can't be; requests that arrive while a clip can't 
+ * be interrupted either replace any request already waiting or queue up 
+ * behind it; and a request for a clip with a higher priority than the one 
+ * playing interrupts it regardless. Scrubbing doesn't interrupt such a clip 
+ * either: !scrub positions that arrive while it can't be interrupted are 
+ * dropped.
+ * 
+ * Without the compositor, VLC draws the video in a window. If 
+ * PERSISTENT_SURFACE is defined, that window is one MediaPlayer makes at 
+ * startup (needs X; link with -lX11) and keeps until it exits. VLC is told to 
+ * draw into it, so switching clips doesn't open and close windows, and 
+ * !toggleFS has the window manager resize the window rather than having VLC 
+ * make a new fullscreen one, which avoids a visible flash. The "surface" 
+ * command shows how many clip switches needed a new video output and how 
+ * long setting one up took. (The compositor draws on the framebuffer it maps 
+ * at startup, so it has a persistent surface anyway.)
+ * 
+ * Similarly, if PERSISTENT_AUDIO is defined, the clips' sound doesn't go 
+ * through an audio output VLC opens and closes with each clip, which costs 
+ * time and makes the Pi's audio pop. MediaPlayer opens the ALSA device 
+ * AUDIO_DEVICE once at startup (link with -lasound) and VLC hands it the 
+ * clips' decoded audio through libVLC's audio callbacks. The device's buffer 
+ * is AUDIO_BUFFER_MS long unless the environment variable MP_AUDIO_BUFFER_MS 
+ * says otherwise. Since nothing but the device's buffer paces what VLC hands 
+ * over, each buffer of sound is checked against its presentation time: sound 
+ * that would be heard more than AUDIO_SYNC_MS early is held back with 
+ * silence, and sound that would be heard that much late is dropped, so the 
+ * clip's sound stays with its pictures. If the device can't be opened, VLC 
+ * is left to open its own audio output for each clip, as without 
+ * PERSISTENT_AUDIO. The "audio" command shows how long after a clip switch 
+ * its sound reached the device, how many dropouts (underruns) there were 
+ * and how much correcting the sync took. 
+ * The sound effects have handles on AUDIO_DEVICE of their own, so they mix 
+ * with the clip's sound as long as the device can mix (ALSA's "default" can).
+ * 
+ * The controller knows which clips might be asked for next -- e.g., the five 
+ * openSiteNClips once a visitor is at the boat -- and can say so with 
+ * "!prefetch <clipId> [<clipId> ...]". MediaPlayer then has the kernel start 
+ * reading the clips' files into the page cache, up to PREFETCH_BUDGET_MB in 
+ * all, and has VLC parse them. With the compositor and PREFETCH_PREROLL 
+ * defined, the first one is also opened, paused at its first frame, on the 
+ * deck that isn't in use, so starting it is just a matter of unpausing it. 
+ * Each !prefetch replaces the hints before it; one with no clipIds just 
+ * cancels them. The "prefetch" command shows the hints, how often the clip 
+ * started was one of them and how much sooner such clips started playing.
+ * 
+ * Clips can have audio tracks in several languages (see mediadef.h). The 
+ * controller picks one with "!lang <code>"; main loop switches the clip 
+ * that's playing to that track on the fly, without restarting anything, and 
+ * each later clip to it as soon as its audio track shows up. The "lang" 
+ * command shows the tracks the current clip has and how long switches took 
+ * to take effect.
+ * 
+ * The controller can also have text and a badge (see mediadef.h) shown over 
+ * whatever is playing with the !overlay command, so that, e.g., one score 
+ * clip with the score overlaid can take the place of one clip per score. The 
+ * overlay is drawn by VLC's marquee (text) and logo (badge) filters, which 
+ * also works with the compositor since VLC blends them into the frames it 
+ * hands over. It stays up across clips until it's cleared. The "overlay" 
+ * command shows what's up and how long updates took.
+ * 
+ * Startup is done in phases, each of which is timed; the "startup" command 
+ * shows how long each took and when the first frame of video appeared. The 
+ * link to the controller is set up on the controller thread while main sets 
+ * up VLC, and if DEFAULT_LOOP_ID is defined, that loop starts playing as soon 
+ * as the media player exists, before the controller has said anything. 
+ * Loading the sound effects, which nothing on the screen depends on, is left 
+ * until after that. The startup times are printed once the first clip is 
+ * playing.
+ * 
+ * Building is done with the tasks in .vscode/tasks.json. The default task is 
+ * the debug build. For the exhibit, use "Release build" or, better, the two 
+ * PGO tasks: build with "PGO step 1", run the exhibit through a representative 
+ * storyboard session and end it with the stop command (the profile is only 
+ * written on a normal exit), then build with "PGO step 2". The cross build 
+ * task does the same thing from a faster machine given a copy of the Pi's 
+ * root filesystem in PI_SYSROOT.
+ * 
  ***
  * 
  * Copyright (C) 2020-2022 D.L. Ehnebuske
@@ -53,6 +232,7 @@
  * SOFTWARE. 
  * 
 ***/
+#define _GNU_SOURCE                                 // For dladdr()
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -60,157 +240,3664 @@
 #include <unistd.h>
 #include <termios.h>
 #include <time.h>
+#include <stdint.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/prctl.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fb.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <alsa/asoundlib.h>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include <wiringPi.h>
 #include <vlc/vlc.h>
 
 
-#include "mediadef.h"                               // Definition of the media clips
+#include "mediadef.h"                               // Definition of the media clips
+
+#define CONTROLLER_TTY  "/dev/ttyACM0"              // The tty we use to talk to the exhibit controller
+#define MAX_LINE_LENGTH (128)                       // The maximum length of a user's input (chars)
+#define MAX_WORDS       (8)                         // The maximum number of words in a command line
+#define MAX_WSIZE       (20)                        // The maximum length of a word (chars)
+#define BANNER          "PTMSC Pinto Abalone Exhibit Media Player v0.1, February 2022"
+#define CMD_SET_VERS    (1000)                      // The version of the command set we speak with the controller
+// #define ESCAPE_SEC   (300)                       // Uncomment to stop after this many seconds of running (for testing)
+#define DEFAULT_LOOP_ID (1)                         // Loop to play until the controller sets one. Comment out to show nothing
+#define DEBUG                                       // Uncomment to enable debugginh output
+// #define COMPOSITOR                               // Uncomment to composite the video ourselves, with crossfades
+#define PERSISTENT_SURFACE                          // Comment out to have VLC make its own window for each clip
+#define WINDOW_WIDTH    (960)                       // Size of the video window when not fullscreen (pixels)
+#define WINDOW_HEIGHT   (540)
+#define PERSISTENT_AUDIO                            // Comment out to have VLC open the audio device for each clip
+#define AUDIO_DEVICE    "default"                   // The ALSA device the clips' sound goes to
+#define AUDIO_RATE      (48000)                     // Sample rate VLC delivers the clips' sound at (Hz)
+#define AUDIO_CHANNELS  (2)                         // Number of channels VLC delivers the clips' sound in
+#define AUDIO_BUFFER_MS (100)                       // Default length of the audio device's buffer (ms)
+#define AUDIO_SYNC_MS   (20)                        // How far a clip's sound may be off its pts before it's corrected (ms)
+#define SFX_CHUNK       (1024)                      // Most frames of a sound effect written at once; a restart cuts in between
+#define FB_DEVICE       "/dev/fb0"                  // The framebuffer the compositor draws on
+#define CROSSFADE_MS    (400)                       // Default length of a compositor crossfade (ms)
+#define FRAME_RATE      (30)                        // Frame rate of the clips; sets the compositor's time budget
+#define BENCH_FRAMES    (100)                       // Number of frames blended by the blendbench command
+#define THERMAL_PATH    "/sys/class/thermal/thermal_zone0/temp"             // SoC temperature (millidegrees C)
+#define THROTTLE_PATH   "/sys/devices/platform/soc/soc:firmware/get_throttled" // Firmware throttle flags (hex)
+#define THROTTLE_NOW    (0x6)                       // get_throttled bits: ARM frequency capped or throttled now
+#define TEMP_HOT_MC     (70000)                     // Temperature (millidegrees C) above which we step down a rendition
+#define LOAD_HIGH       (0.8)                       // 1-minute load average per CPU above which we step down
+#define DROP_HIGH       (0.02)                      // Recent dropped-frame fraction above which we step down
+#define DROP_WEIGHT     (0.5)                       // Weight of the latest clip in the recent dropped-frame fraction
+#define SCRUB_IDLE_MS   (3000)                      // Scrubbing ends when no !scrub arrives for this long (ms)
+#define SCRUB_SEEK_MS   (250)                       // Issue the next seek after this long even if the last hasn't shown up
+#define SCRUB_LAST_POS  (0.995)                     // Furthest a scrub seeks; a seek to 1.0 ends the clip
+#define VLCLOG_ENTRIES  (256)                       // Number of VLC log messages kept
+#define VLCLOG_TEXT_MAX (120)                       // Maximum length of a kept VLC log message (chars)
+#define VLCLOG_MOD_MAX  (16)                        // Maximum length of a VLC module name (chars)
+#define VLCLOG_LEVEL    (LIBVLC_WARNING)            // Default minimum level of VLC log messages kept
+#define VLCLOG_FILTERS  (8)                         // Maximum number of per-module level settings
+#define VLCLOG_RATE     (50)                        // Maximum number of VLC log messages kept per second
+#define TRACE_ENTRIES   (4096)                      // Number of trace records kept
+#define TRACE_TEXT_MAX  (32)                        // Maximum length of the text in a trace record (chars)
+#define TRACE_PATH      "/home/pi/MediaPlayer-trace.json" // Where the trace is written if no file is given
+#define BENCH_THREADS   (64)                        // Maximum number of threads powerbench keeps track of
+#define BENCH_SECS      (30)                        // Default length of a powerbench run (s)
+#define BENCH_SETTLE_SECS (3)                       // Time "MediaPlayer powerbench" lets each mode settle before measuring it (s)
+#define BENCH_LOOP_ID   (1)                         // Loop "MediaPlayer powerbench" measures looping mode with
+#define BENCH_CLIP_ID   (5)                         // Clip it measures playing mode with; should outlast the settle time and run
+#define PREFETCH_MAX    (MAX_WORDS - 1)             // Maximum number of clips in a !prefetch
+#define PREFETCH_BUDGET_MB (256)                    // Most clip file data to have read ahead at once (MB)
+#define PREFETCH_PARSE_MS (2000)                    // How long VLC may take parsing a prefetched clip (ms)
+#define PREFETCH_PREROLL                            // Comment out to not pre-roll the first hinted clip (compositor only)
+#define OVERLAY_TEXT_MAX (64)                      // Maximum length of overlay text (chars)
+#define OVERLAY_TEXT_SIZE (72)                      // Height of overlay text (pixels)
+#define OVERLAY_TEXT_POS (8)                        // Where the text goes: libVLC position bits (1 left, 2 right, 4 top, 8 bottom; 0 center)
+#define OVERLAY_BADGE_POS (6)                       // Where the badge goes: top right
+#define PROFILE_HZ      (199)                       // Profiler samples per second of CPU time
+#define PROFILE_SECS    (10)                        // Default length of a profile run (s)
+#define PROFILE_MAX_SECS (60)                       // Longest profile run allowed (s)
+#define PROFILE_SAMPLES (16384)                     // Most samples kept in a profile run
+#define PROFILE_DEPTH   (32)                        // Most stack frames kept per sample
+#define PROFILE_PATH    "/home/pi/MediaPlayer-profile.folded" // Where the profile is written if no file is given
+#define HISTORY_PATH    "/home/pi/MediaPlayer-history.dat" // The latency history file
+#define HISTORY_MAGIC   "MPHIST1"                   // What the history file starts with; change if its layout changes
+#define HISTORY_HOURS   (24 * 7)                    // Number of hourly rollups kept
+#define HISTORY_DAYS    (180)                       // Number of daily rollups kept
+#define HISTORY_BUCKETS (64)                        // Buckets in a history histogram (two per power of 2)
+#define HISTORY_CLIPS   (64)                        // Clips the history file has room for (at least CLIP_COUNT)
+#define HISTORY_REPORT  (14)                        // Default number of periods the history command covers
+#define EVENT_QUEUE_MAX (32)                        // Maximum number of events waiting for main loop
+#define PENDING_MAX     (8)                         // Maximum number of clip requests waiting for an uninterruptible clip
+
+#ifdef COMPOSITOR
+#undef PERSISTENT_SURFACE                           // The compositor's framebuffer is its surface
+#endif
+
+// piLock() / piUnlock() usage
+#define LOCK_SCRUB      (1)                         // piLock(1) is for changing the scrub position
+#define LOCK_PREFETCH   (2)                         // piLock(2) is for changing the prefetch hints
+#define LOCK_OVERLAY    (3)                         // piLock(3) is for changing the overlay
+
+// Return codes
+#define RET_OK          (0)                         // Normal end
+#define RET_MICF        (-1)                        // Media item creation failure
+#define RET_MPCF        (-2)                        // Media player creation failure
+#define RET_MPPF        (-3)                        // Media player play failure
+#define RET_KTCF        (-4)                        // Keyboard thread creation failure
+#define RET_CTCF        (-5)                        // Controller thread creation failure
+#define RET_OCTF        (-6)                        // Open controller TTY failure
+#define RET_OFBF        (-7)                        // Open framebuffer failure
+#define RET_STCF        (-8)                        // Signal thread creation failure
+#define RET_HSTF        (-11)                       // History query failure
+#define RET_PBFF        (-12)                       // "MediaPlayer powerbench" failed, or couldn't run
+
+// Startup phases, for timing
+enum startupPhases {
+    phSignals,          // Starting the signal thread
+    phKeyboard,         // Starting the keyboard thread
+    phHistory,          // Mapping the history file
+    phController,       // Starting the controller thread
+    phLink,             // Opening and setting up the controller's tty (on the controller thread)
+    phEngine,           // Starting libVLC
+    phMedia,            // Making the media items
+    phPlayer,           // Making the media player(s)
+    phSurface,          // Making the window the video is shown in
+    phAudio,            // Opening the audio device
+    phSfx,              // Loading the sound effects
+    PHASE_COUNT
+};
+
+/***
+ * 
+ * Global variables
+ * 
+ ***/
+FILE *ctlIn;                                        // The input stream for the exhibit controller
+FILE *ctlOut;                                       // The output stream for the controller
+libvlc_instance_t * inst;                           // The libVLC engine we'll be using
+libvlc_media_player_t *mp;                          // The media player we'll use
+libvlc_media_t *m[CLIP_COUNT][RENDITION_MAX];       // The clips' renditions represented as media items; NULL if none
+libvlc_media_t *mProxy[CLIP_COUNT];                 // The clips' scrub proxies as media items; NULL if none
+bool running = true;                                // When this goes false (e.g., the stop command), we shut down
+int exitCode = RET_OK;                              // What main returns once running goes false
+bool isFullscreen =                                 // Whether we display the video in fullscreen mode
+#ifdef DEBUG 
+false; 
+#else 
+true; 
+#endif
+
+// Video surface
+#ifdef PERSISTENT_SURFACE
+Display *xDisplay = NULL;                           // Our connection to the X server
+Window xWindow;                                     // The window all the clips are shown in
+#endif
+long long switchMicros = 0;                         // When the latest clip switch started
+bool voutPending = false;                           // Whether we're waiting to see if the switch needs a new video output
+bool playPending = false;                           // Whether we're waiting for the switched-to clip to start playing
+unsigned long switchCount = 0;                      // Number of clip switches
+unsigned long voutCount = 0;                        // Number of them that needed a new video output
+long long voutTotalMicros = 0;                      // Total time from switch to new video output
+long long voutMaxMicros = 0;                        // Longest such time
+long long switchTotalMicros = 0;                    // Total time from switch to the clip playing
+long long switchMaxMicros = 0;                      // Longest such time
+
+// Audio output
+#ifdef PERSISTENT_AUDIO
+snd_pcm_t *pcm = NULL;                              // The audio device, open for MediaPlayer's whole life
+#endif
+int audioBufferMs = AUDIO_BUFFER_MS;                // Length of its buffer (ms)
+bool audioPending = false;                          // Whether we're waiting for the switched-to clip's sound
+unsigned long audioStarts = 0;                      // Number of clip switches whose sound reached the device
+long long audioStartTotalMicros = 0;                // Total time from switch to sound reaching the device
+long long audioStartMaxMicros = 0;                  // Longest such time
+unsigned long audioUnderruns = 0;                   // Total number of underruns (dropouts)
+unsigned long clipUnderruns = 0;                    // Number of them in the clip now playing
+unsigned long clipUnderrunsMax = 0;                 // Most of them in any one clip
+long long audioLost = 0;                            // Audio buffers VLC reported lost
+unsigned long audioPadFrames = 0;                   // Frames of silence written to hold early sound back
+unsigned long audioDropFrames = 0;                  // Frames of late sound dropped
+long long audioOffsetMaxMicros = 0;                 // Furthest any buffer of sound was off its pts (us)
+
+// Startup timing, in microsNow() time
+typedef struct phaseTime_t {
+    long long begin;                                // When the phase began; 0 if it hasn't
+    long long end;                                  // When it ended; 0 if it hasn't
+} phaseTime_t;
+phaseTime_t phaseTime[PHASE_COUNT];
+long long mainMicros = 0;                           // When main started
+long long firstFrameMicros = 0;                     // When the media player first started playing
+double uptimeAtMain = 0.0;                          // System uptime when main started (s)
+
+// The states main loop can be in
+enum playerStates {
+    stWaiting,          // Nothing to play; waiting to be told what to
+    stLooping,          // Playing the looping clip
+    stPlaying,          // Playing a requested clip that can be interrupted
+    stGuarded,          // Playing a requested clip that can't be interrupted until its guardMs are up
+    stLocked,           // Playing a fullPlay clip; can't be interrupted
+    stScrubbing,        // Showing a clip paused at a position set by !scrub
+    STATE_COUNT,
+    stSame,             // In transitions[]: stay in the same state
+    stFromClip          // In transitions[]: go to the state that fits the clip now playing
+};
+
+// The events that drive main loop. Other threads post them with postEvent(); main loop's timers 
+// produce the ones marked (timer).
+enum playerEvents {
+    evPlayClip,         // Play clip arg
+    evPriorityClip,     // Play clip arg, which outranks the one playing. (evPlayClip becomes this.)
+    evSetLoop,          // Make clip arg the looping clip
+    evPlaying,          // The clip player started playing
+    evClipEnd,          // The clip player reached the end of the clip (or failed)
+    evGuardExpired,     // (timer) The clip playing can now be interrupted
+    evScrub,            // There's a new scrub position (see scrubPending)
+    evSeekDone,         // The scrub seek in flight has completed
+    evSeekDue,          // (timer) It's time to issue the next scrub seek
+    evScrubIdle,        // (timer) No !scrub for SCRUB_IDLE_MS
+    evPrefetch,         // There are new prefetch hints (see hintPending)
+    evLang,             // Switch to language arg (index into languages[])
+    evAudioTrack,       // The clip playing has a new audio track
+    evOverlay,          // There's a new overlay (see overlayPending)
+    evFadeDone,         // The compositor has finished a crossfade
+    evEscape,           // (timer) Escape hatch: time to stop
+    evStop,             // Stop the media player
+    EVENT_COUNT
+};
+
+typedef struct playerEvent_t {
+    enum playerEvents type;                         // What happened
+    int arg;                                        // Event-dependent value
+    long long micros;                               // microsNow() when it was posted
+} playerEvent_t;
+
+// The queue of events waiting for main loop. Any thread may post to it. Protected by eventLock; 
+// eventReady is signalled when an event is added.
+playerEvent_t eventQueue[EVENT_QUEUE_MAX];
+int eventHead = 0;                                  // Index of the oldest event in the queue
+int eventCount = 0;                                 // Number of events in the queue
+pthread_mutex_t eventLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t eventReady;
+
+// Main loop's state. Only main loop changes these.
+enum playerStates playerState = stWaiting;          // The state main loop is in
+int reqLoopId = 0;                                  // The id of the clip that plays when no clip is playing; 0 if none
+int nowPlayingId = 0;                               // The id of the clip the media player was last started on; 0 if none
+int nowPlayingRendition = 0;                        // The rendition of nowPlayingId the media player was started on; 
+                                                    //   -1 if it's the scrub proxy
+long long nowPlayingStartMicros = 0;                // microsNow() when nowPlayingId was started
+long long guardUntilMicros = 0;                     // microsNow() when nowPlayingId becomes interruptible
+int pending[PENDING_MAX];                           // Requested clips waiting for nowPlayingId to finish, oldest first
+int pendingCount = 0;                               // Number of clips in pending
+long long timerAt[EVENT_COUNT];                     // microsNow() when main loop should generate each (timer) event; 0 if not set
+
+// Inter-thread communication for scrubbing. To move the scrub position, do a piLock(LOCK_SCRUB), 
+// set scrubClipId and scrubPermille, and, if scrubPending isn't already set, set it and post an 
+// evScrub. Then do a piUnlock(LOCK_SCRUB). Main loop does the same ritual to take the position 
+// and clear scrubPending. Only the latest position matters; ones that arrive in the meantime 
+// replace each other.
+int scrubClipId;
+int scrubPermille;
+bool scrubPending = false;
+long long scrubRequestMicros;                       // microsNow() when the latest !scrub arrived
+
+// Main loop's language state. The language latency is from !lang to libVLC saying the new track 
+// is selected.
+int langId = 0;                                     // The language (index into languages[]) clips play in
+bool langPending = false;                           // Whether a track switch is in flight
+long long langRequestMicros = 0;                    // microsNow() when the !lang it's for arrived
+unsigned long langSwitches = 0;                     // Number of track switches completed
+long long langTotalMicros = 0;                      // Total and maximum !lang-to-selected times (us)
+long long langMaxMicros = 0;
+
+// Inter-thread communication for the overlay. Same ritual as for scrubbing, with LOCK_OVERLAY, 
+// overlayText and overlayBadge, overlayPending and evOverlay.
+char overlayText[OVERLAY_TEXT_MAX];                 // Text to show; "" for none
+int overlayBadge = -1;                              // Badge (index into badges[]) to show; -1 for none
+bool overlayPending = false;
+long long overlayRequestMicros;                     // microsNow() when the latest !overlay arrived
+
+// Overlay update latency: from !overlay to main loop having told VLC and, with the compositor, to 
+// the first frame shown after that
+long long overlayAppliedMicros = 0;                 // microsNow() when main loop last told VLC; 0 if never
+long long overlayShownFrom = 0;                     // overlayRequestMicros of the update not yet seen on screen; 0 if none
+unsigned long overlayUpdates = 0;
+long long overlayApplyTotalMicros = 0;              // Total and maximum !overlay-to-applied times (us)
+long long overlayApplyMaxMicros = 0;
+unsigned long overlayShown = 0;
+long long overlayShownTotalMicros = 0;              // Total and maximum !overlay-to-frame times (us)
+long long overlayShownMaxMicros = 0;
+
+// Inter-thread communication for prefetching. Same ritual as for scrubbing, with LOCK_PREFETCH, 
+// hintIds and hintCount, hintPending and evPrefetch.
+int hintIds[PREFETCH_MAX];
+int hintCount = 0;
+bool hintPending = false;
+
+// Main loop's prefetch state
+typedef struct prefetch_t {
+    int clipId;                                     // The clip hinted
+    int rendition;                                  // The rendition of it that was prefetched
+    long long bytes;                                // Size of the file read ahead; 0 if it wasn't
+} prefetch_t;
+prefetch_t prefetch[PREFETCH_MAX];                  // The latest hints
+int prefetchCount = 0;                              // Number of them
+int prerollId = -1;                                 // Clip paused at its start on the idle deck; -1 if none
+int prerollRendition;                               // Its rendition
+int prerollDeck;                                    // The deck it's on
+libvlc_media_t *prerollMedia = NULL;                // The start-paused copy of its media item
+libvlc_media_t *nowPlayingCopy = NULL;              // The pre-rolled copy the clip playing was started from; NULL if none
+enum prefetchResults {pfNone, pfHit, pfMiss} switchPrefetch = pfNone;  // How the latest clip switch fared
+unsigned long prefetchHits = 0;                     // Clips started that had been hinted
+unsigned long prefetchMisses = 0;                   // Clips started while there were hints but that weren't
+unsigned long prerollHits = 0;                      // Clips started that had been pre-rolled
+long long hitSwitchMicros = 0;                      // Total switch-to-playing time for hits
+unsigned long hitSwitches = 0;
+long long missSwitchMicros = 0;                     // Total switch-to-playing time for misses
+unsigned long missSwitches = 0;
+
+// Main loop's scrub state
+bool scrubHasTarget = false;                        // Whether there's a scrub position we haven't sought to yet
+bool scrubNeedsHold = false;                        // Whether the scrubbed clip needs pausing once it starts playing
+float scrubTarget = 0.0;                            // The position to seek to next (0.0 .. 1.0)
+long long scrubTargetMicros = 0;                    // scrubRequestMicros for scrubTarget
+
+// Seek latency statistics for the scrub in progress. A seek is in flight from the time main loop 
+// issues it until libVLC reports the position changed to one nearer the target than seekFrom. 
+// Changes reported before VLC gets to the seek are still at (or near) seekFrom.
+bool seekInFlight = false;
+float seekFrom = 0.0;                               // The last position reported before the seek in flight
+float lastPosition = 0.0;                           // The last position reported by the active deck
+long long seekIssuedMicros = 0;                     // microsNow() when the seek in flight was issued
+long long seekRequestMicros = 0;                    // scrubRequestMicros of the request the seek is for
+int seekCount;                                      // Number of seeks completed in this scrub
+long long seekTotalMicros;                          // Total and maximum request-to-position-change times (us)
+long long seekMaxMicros;
+
+// A sound effect, decoded into memory, together with the handle on the audio device and the 
+// thread that plays it. The thread sleeps on sfxTriggered until restart is set.
+typedef struct sfxPlayer_t {
+    int16_t *samples;                               // The effect's interleaved samples; NULL if not loaded
+    snd_pcm_uframes_t frames;                       // The number of frames in samples
+    unsigned channels;                              // The number of channels in each frame
+    snd_pcm_t *pcm;                                 // The effect's own handle on AUDIO_DEVICE
+    long long triggerMicros;                        // microsNow() when the effect was last triggered
+    atomic_bool restart;                            // Triggered; the thread is to (re)start from the first frame
+} sfxPlayer_t;
+sfxPlayer_t sfxPlayer[SFX_COUNT];
+pthread_mutex_t sfxLock = PTHREAD_MUTEX_INITIALIZER;   // Guards triggerMicros and setting restart
+pthread_cond_t sfxTriggered = PTHREAD_COND_INITIALIZER; // Broadcast when an effect is triggered
+
+// The compositor's state. A deck is a media player that decodes into a pair of frame buffers 
+// through libVLC's video callbacks: VLC decodes into back while the compositor reads front. They 
+// are swapped, under lock, when VLC displays a frame. The active deck is the one that mp refers 
+// to; the other holds the last frame of the previous clip while we fade away from it. Each deck's 
+// display callback runs on its own VLC thread, so compLock makes presenting a frame and swapping 
+// decks one at a time; it's taken before any deck's lock.
+typedef struct deck_t {
+    libvlc_media_player_t *mp;                      // The media player for this deck
+    uint8_t *buf[2];                                // The deck's frame buffers
+    int front;                                      // Index of the buffer with the latest complete frame
+    pthread_mutex_t lock;                           // Protects front and the contents of buf[front]
+    bool needsStop;                                 // Deck has been retired and its player should be stopped
+} deck_t;
+deck_t deck[2];                                     // The two decks
+pthread_mutex_t compLock = PTHREAD_MUTEX_INITIALIZER;   // Serializes compPresent() and compSwapDecks()
+atomic_int activeDeck = 0;                          // The index of the deck that's playing the current clip
+int crossfadeMs = CROSSFADE_MS;                     // Length of crossfade (ms); 0 for hard cuts
+atomic_bool fading = false;                         // Whether a crossfade is in progress
+long long fadeStartMicros = 0;                      // microsNow() at first frame of the fade; 0 if not yet started
+// Frame statistics for choosing renditions. libVLC's counts for a media item are cumulative, so 
+// we keep the last values we saw for each one to get the counts for the latest play.
+int lastDisplayed[CLIP_COUNT][RENDITION_MAX];       // Displayed frames of each media item when last checked
+int lastLost[CLIP_COUNT][RENDITION_MAX];            // Lost (dropped) frames of each media item when last checked
+int lastLostAudio[CLIP_COUNT][RENDITION_MAX];       // Lost audio buffers of each media item when last checked
+long long renditionDisplayed[RENDITION_MAX];        // Total frames displayed in each rendition
+long long renditionLost[RENDITION_MAX];             // Total frames dropped in each rendition
+double recentDropRate = 0.0;                        // Recent dropped-frame fraction, weighted toward the latest clip
+
+// The VLC log ring. onVlcLog() claims an entry by incrementing vlcLogHead and marks it complete 
+// by setting its seq to one more than the count it claimed, so a reader can tell entries that are 
+// complete and current from ones being overwritten. Nothing blocks.
+typedef struct vlcLogEntry_t {
+    atomic_uint seq;                                // 1 + the value of vlcLogHead that claimed the entry; 0 while written
+    long long micros;                               // microsNow() when the message was logged
+    int level;                                      // The message's LIBVLC_* level
+    char module[VLCLOG_MOD_MAX];                    // The VLC module that logged it
+    char text[VLCLOG_TEXT_MAX];                     // The message
+} vlcLogEntry_t;
+vlcLogEntry_t vlcLog[VLCLOG_ENTRIES];
+atomic_uint vlcLogHead = 0;                         // Number of messages ever put in the ring
+atomic_uint vlcLogDropped = 0;                      // Number of messages not kept because of the rate limit
+atomic_llong vlcLogSecond = 0;                      // The second (microsNow() / 1000000) being rate limited
+atomic_int vlcLogInSecond = 0;                      // Number of messages kept during vlcLogSecond
+
+// The per-module minimum levels for the VLC log. An entry with an empty module is unused.
+typedef struct vlcLogFilter_t {
+    char module[VLCLOG_MOD_MAX];                    // The VLC module
+    int level;                                      // Minimum level kept for it; LIBVLC_ERROR + 1 for none
+} vlcLogFilter_t;
+vlcLogFilter_t vlcLogFilter[VLCLOG_FILTERS];
+int vlcLogLevel = VLCLOG_LEVEL;                     // Minimum level kept for modules not in vlcLogFilter
+
+// The trace. Works the same way as the VLC log ring: traceEvent() claims a record by incrementing 
+// traceHead and marks it complete by setting its seq.
+enum traceTypes {
+    trCommand,          // A command was executed; text is the command line
+    trController,       // A line arrived from the controller; text is the line
+    trState,            // Main loop did something; text says what, a is the clip id, b depends
+    trVlcEvent          // A libVLC media player event; text is the event, a is the clip player's deck
+};
+typedef struct traceRecord_t {
+    atomic_uint seq;                                // 1 + the value of traceHead that claimed the record; 0 while written
+    enum traceTypes type;                           // The kind of record
+    long long nanos;                                // CLOCK_MONOTONIC time of the record (ns)
+    int tid;                                        // The Linux thread id of the thread that made the record
+    int a;                                          // Type-dependent values
+    int b;
+    char text[TRACE_TEXT_MAX];                      // Type-dependent text
+} traceRecord_t;
+traceRecord_t traceRing[TRACE_ENTRIES];
+atomic_uint traceHead = 0;                          // Number of records ever put in traceRing
+
+// What main loop is doing, for powerbench. The limits are what the player should stay within in 
+// each mode on the exhibit's Pi; powerbench fails if any is exceeded.
+enum playerModes {
+    waitingMode,        // Waiting for the controller to say what to play
+    loopingMode,        // Playing the looping clip
+    playingMode,        // Playing (or scrubbing) a requested clip
+    MODE_COUNT
+};
+typedef struct modeLimits_t {
+    char name[12];                                  // Name of the mode
+    double maxWakeups;                              // Maximum wakeups per second, all threads together
+    double maxCpuPct;                               // Maximum CPU use (% of one CPU), all threads together
+    long maxRssKB;                                  // Maximum resident memory (KB)
+} modeLimits_t;
+modeLimits_t modeLimits[MODE_COUNT] = {
+    {"waiting", 150.0, 2.0, 150000},
+    {"looping", 1500.0, 60.0, 250000},
+    {"playing", 1500.0, 60.0, 250000}
+};
+enum playerModes playerMode = waitingMode;
+int benchSecs = 0;                                  // Seconds per mode when run as "MediaPlayer powerbench"; else 0
+
+// The profiler's samples. The SIGPROF handler claims one by incrementing profileHead; ones past 
+// the end are counted but not kept. The buffer is allocated by the first run and kept from then on, 
+// so a handler that's still running when a run ends never writes to freed memory.
+typedef struct profileSample_t {
+    int tid;                                        // The thread that was running
+    int depth;                                      // Number of frames in pc
+    void *pc[PROFILE_DEPTH];                        // Its stack, innermost first
+} profileSample_t;
+profileSample_t *profileSamples = NULL;             // PROFILE_SAMPLES of them once a run has been taken
+atomic_uint profileHead;                            // Number of samples taken in the run
+atomic_int profileInHandler;                        // Number of handlers running right now
+atomic_llong profileHandlerNanos;                   // CPU time spent in the handler in the run (ns)
+atomic_flag profileBusy = ATOMIC_FLAG_INIT;         // Set while a run is in progress
+
+// The latency history file's layout. Everything in it is fixed size, so the file is too. Periods go 
+// by the local clock, so a day runs from local midnight to local midnight. A period's start is in 
+// seconds since the epoch; a rollup whose start isn't the one wanted is left over from an earlier 
+// go-around of the ring and is started over when next used.
+enum historyMetrics {
+    hmSwitch,           // Clip switch to the clip playing (us)
+    hmFirstFrame,       // Clip switch to the clip's first frame (us)
+    hmDropped,          // Frames dropped in a clip (per mille)
+    hmLinkRtt,          // !videoEnds to the controller's next command (us); not per clip
+    HISTORY_METRICS
+};
+#define HISTORY_CLIP_METRICS (hmLinkRtt)            // The metrics that are also kept per clip
+
+typedef struct historyStat_t {
+    uint32_t count;                                 // Number of values
+    uint32_t max;                                   // Largest of them
+    uint64_t sum;                                   // Their total
+    uint32_t bucket[HISTORY_BUCKETS];               // Their histogram; see histBucket()
+} historyStat_t;
+
+typedef struct historyClipStat_t {
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+} historyClipStat_t;
+
+typedef struct historyPeriod_t {
+    int64_t start;                                  // When the hour or day began
+    historyStat_t all[HISTORY_METRICS];             // The metrics for all clips together
+} historyPeriod_t;
+
+typedef struct historyFile_t {
+    char magic[8];                                  // HISTORY_MAGIC
+    historyPeriod_t hour[HISTORY_HOURS];            // Hourly rollups, a ring indexed by hour number
+    historyPeriod_t day[HISTORY_DAYS];              // Daily rollups, ditto by day number
+    historyClipStat_t dayClip[HISTORY_DAYS][HISTORY_CLIPS][HISTORY_CLIP_METRICS];  // Days' per-clip metrics
+} historyFile_t;
+
+historyFile_t *history = NULL;                      // The mapped history file; NULL if it couldn't be
+pthread_mutex_t historyLock = PTHREAD_MUTEX_INITIALIZER;  // Serializes updates to it
+int switchClipId = 0;                               // The clip the latest switch was to
+bool framePending = false;                          // Whether we're waiting for its first frame
+long long linkSentMicros = 0;                       // When !videoEnds was sent; 0 once the controller's responded
+
+// What powerbench learns about a thread from /proc
+typedef struct threadSample_t {
+    int tid;                                        // The thread's id
+    char name[16];                                  // Its name
+    long long wakeups;                              // Voluntary context switches so far
+    long long preempts;                             // Involuntary context switches so far
+    long long cpuTicks;                             // User plus system CPU time so far (clock ticks)
+} threadSample_t;
+
+uint8_t *fb = NULL;                                 // The mmap'ed framebuffer
+unsigned fbWidth = 1920;                            // Framebuffer geometry. (The defaults are used by blendbench 
+unsigned fbHeight = 1080;                           //   when there's no framebuffer.)
+unsigned fbStride;                                  // Bytes per framebuffer line
+size_t fbSize;                                      // Bytes in the framebuffer mapping
+
+/***
+ * 
+ * microsNow    Return the number of microseconds since some arbitrary (but fixed) time. For 
+ *              measuring how long things take.
+ * 
+ ***/
+long long microsNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/***
+ * 
+ * postEvent    Add an event of the given type to main loop's queue and wake it up. Safe to use 
+ *              on any thread, including libVLC's; it never calls libVLC.
+ * 
+ ***/
+void postEvent(enum playerEvents type, int arg) {
+    pthread_mutex_lock(&eventLock);
+    if (eventCount == EVENT_QUEUE_MAX) {
+        printf("Event queue full; dropped event %d (%d).\n", type, arg);
+    } else {
+        playerEvent_t *e = &eventQueue[(eventHead + eventCount) % EVENT_QUEUE_MAX];
+        e->type = type;
+        e->arg = arg;
+        e->micros = microsNow();
+        eventCount++;
+        pthread_cond_signal(&eventReady);
+    }
+    pthread_mutex_unlock(&eventLock);
+}
+
+/***
+ * 
+ * nextEvent    Wait for the next event for main loop and put it in e. An event in the queue 
+ *              comes first; otherwise, the earliest of main loop's timers that has come due. 
+ *              Sleeps until one or the other happens.
+ * 
+ ***/
+void nextEvent(playerEvent_t *e) {
+    pthread_mutex_lock(&eventLock);
+    while (eventCount == 0) {
+        int due = -1;
+        for (int t = 0; t < EVENT_COUNT; t++) {
+            if (timerAt[t] != 0 && (due < 0 || timerAt[t] < timerAt[due])) {
+                due = t;
+            }
+        }
+        if (due < 0) {
+            pthread_cond_wait(&eventReady, &eventLock);
+        } else if (timerAt[due] <= microsNow()) {
+            e->type = due;
+            e->arg = 0;
+            e->micros = timerAt[due];
+            timerAt[due] = 0;
+            pthread_mutex_unlock(&eventLock);
+            return;
+        } else {
+            struct timespec until = {timerAt[due] / 1000000, (timerAt[due] % 1000000) * 1000};
+            pthread_cond_timedwait(&eventReady, &eventLock, &until);
+        }
+    }
+    *e = eventQueue[eventHead];
+    eventHead = (eventHead + 1) % EVENT_QUEUE_MAX;
+    eventCount--;
+    pthread_mutex_unlock(&eventLock);
+}
+
+/***
+ * 
+ * traceEvent   Add a record to the trace. text may be NULL; a trailing newline is dropped. 
+ *              Never blocks, so it can be used on any thread, including libVLC's.
+ * 
+ ***/
+void traceEvent(enum traceTypes type, const char *text, int a, int b) {
+    static __thread int tid = 0;
+    if (tid == 0) {
+        tid = syscall(SYS_gettid);
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    unsigned claim = atomic_fetch_add(&traceHead, 1);
+    traceRecord_t *r = &traceRing[claim % TRACE_ENTRIES];
+    atomic_store(&r->seq, 0);
+    r->type = type;
+    r->nanos = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    r->tid = tid;
+    r->a = a;
+    r->b = b;
+    r->text[0] = '\0';
+    if (text != NULL) {
+        strncpy(r->text, text, TRACE_TEXT_MAX - 1);
+        r->text[TRACE_TEXT_MAX - 1] = '\0';
+        r->text[strcspn(r->text, "\r\n")] = '\0';
+    }
+    atomic_store(&r->seq, claim + 1);
+}
+
+/***
+ * 
+ * traceWrite   Write the trace to the file at path in Chrome trace (JSON) format. Each record 
+ *              becomes an instant event on the thread that made it. Returns true if it worked.
+ * 
+ ***/
+bool traceWrite(const char *path) {
+    static const char *category[] = {"command", "controller", "state", "vlc"};
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        printf("Failed to open trace file %s. Error: %s\n", path, strerror(errno));
+        return false;
+    }
+    unsigned head = atomic_load(&traceHead);
+    unsigned first = head > TRACE_ENTRIES ? head - TRACE_ENTRIES : 0;
+    int written = 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (unsigned i = first; i < head; i++) {
+        traceRecord_t *r = &traceRing[i % TRACE_ENTRIES];
+        traceRecord_t copy;
+        if (atomic_load(&r->seq) != i + 1) {
+            continue;                                           // Being written or already overwritten
+        }
+        memcpy(&copy, r, sizeof(copy));
+        if (atomic_load(&r->seq) != i + 1) {
+            continue;                                           // Overwritten while we copied it
+        }
+        copy.text[TRACE_TEXT_MAX - 1] = '\0';
+        fprintf(f, "%s\n{\"name\":\"", written == 0 ? "" : ",");
+        for (char *c = copy.text; *c != '\0'; c++) {            // Escape the text for JSON
+            if (*c == '"' || *c == '\\') {
+                fprintf(f, "\\%c", *c);
+            } else if ((unsigned char)*c < ' ') {
+                fprintf(f, "\\u%04x", *c);
+            } else {
+                fputc(*c, f);
+            }
+        }
+        fprintf(f, "\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"a\":%d,\"b\":%d}}", 
+            category[copy.type], copy.nanos / 1000, copy.nanos % 1000, getpid(), copy.tid, copy.a, copy.b);
+        written++;
+    }
+    fprintf(f, "\n]}\n");
+    bool ok = !ferror(f);
+    if (fclose(f) != 0 || !ok) {
+        printf("Failed to write trace file %s.\n", path);
+        return false;
+    }
+    printf("Wrote %d trace records to %s\n", written, path);
+    return true;
+}
+
+/***
+ * 
+ * histBucket   The histogram bucket value v goes in. Bucket 0 is for 0; after that there are two 
+ *              buckets per power of 2, so a bucket's upper bound is about 1.4 times its lower one.
+ * 
+ ***/
+int histBucket(uint32_t v) {
+    if (v == 0) {
+        return 0;
+    }
+    int e = 31 - __builtin_clz(v);                  // 2^e <= v < 2^(e+1)
+    int upper = e > 0 ? (v >> (e - 1)) & 1 : 0;     // Whether v >= 1.5 * 2^e
+    int b = 1 + 2 * e + upper;
+    return b < HISTORY_BUCKETS ? b : HISTORY_BUCKETS - 1;
+}
+
+// The smallest value that goes in bucket b
+double histBucketLow(int b) {
+    if (b == 0) {
+        return 0.0;
+    }
+    int e = (b - 1) / 2;
+    return ldexp(1.0, e) * ((b - 1) % 2 ? 1.5 : 1.0);
+}
+
+/***
+ * 
+ * histPercentile   Estimate the p-th (0.0 .. 1.0) percentile of the values counted in st by 
+ *                  interpolating within the bucket it falls in
+ * 
+ ***/
+double histPercentile(const historyStat_t *st, double p) {
+    if (st->count == 0) {
+        return 0.0;
+    }
+    double target = p * st->count;
+    double seen = 0.0;
+    for (int b = 0; b < HISTORY_BUCKETS; b++) {
+        if (st->bucket[b] > 0 && seen + st->bucket[b] >= target) {
+            double low = histBucketLow(b);
+            double high = b + 1 < HISTORY_BUCKETS ? histBucketLow(b + 1) : st->max;
+            double v = low + (high - low) * (target - seen) / st->bucket[b];
+            return v < st->max ? v : st->max;
+        }
+        seen += st->bucket[b];
+    }
+    return st->max;
+}
+
+// Add the values counted in from to those in to
+void histMerge(historyStat_t *to, const historyStat_t *from) {
+    to->count += from->count;
+    to->sum += from->sum;
+    to->max = from->max > to->max ? from->max : to->max;
+    for (int b = 0; b < HISTORY_BUCKETS; b++) {
+        to->bucket[b] += from->bucket[b];
+    }
+}
+
+/***
+ * 
+ * historyMap   Map the history file at path. If writable, it's created, or started over if it 
+ *              isn't one of ours, as needed. Returns NULL if that can't be done.
+ * 
+ ***/
+historyFile_t *historyMap(const char *path, bool writable) {
+    int fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0) {
+        printf("Failed to open history file %s. Error: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    bool fresh = fstat(fd, &st) != 0 || st.st_size != sizeof(historyFile_t);
+    if (fresh && !writable) {
+        printf("%s isn't a MediaPlayer history file.\n", path);
+        close(fd);
+        return NULL;
+    }
+    if (fresh && ftruncate(fd, sizeof(historyFile_t)) != 0) {
+        printf("Failed to size history file %s. Error: %s\n", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    historyFile_t *h = mmap(NULL, sizeof(historyFile_t), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);                                      // The mapping stays valid
+    if (h == MAP_FAILED) {
+        printf("Failed to map history file %s. Error: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    if (memcmp(h->magic, HISTORY_MAGIC, sizeof(h->magic)) != 0) {
+        if (!writable) {
+            printf("%s isn't a MediaPlayer history file.\n", path);
+            munmap(h, sizeof(historyFile_t));
+            return NULL;
+        }
+        printf("Starting a new history file, %s.\n", path);
+        memset(h, 0, sizeof(historyFile_t));
+        memcpy(h->magic, HISTORY_MAGIC, sizeof(h->magic));
+    }
+    return h;
+}
+
+/***
+ * 
+ * historyStart     Return the start of the hour or day (len seconds long) containing time t, on 
+ *                  the local clock, and set *number to its number, which says where it goes in a 
+ *                  ring. A day starts at local midnight even if daylight saving time makes it 23 
+ *                  or 25 hours long.
+ * 
+ ***/
+int64_t historyStart(int len, time_t t, int64_t *number) {
+    struct tm tm;
+    localtime_r(&t, &tm);
+    int64_t local = t + tm.tm_gmtoff;                           // The local clock, in seconds since the epoch
+    *number = local / len;
+    if (len < 86400) {
+        return t - local % len;
+    }
+    tm.tm_hour = 0;
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;                                           // Whatever it was at midnight
+    return mktime(&tm);
+}
+
+/***
+ * 
+ * historyDaysAgo   Return a time on the local day i days before the one containing now
+ * 
+ ***/
+time_t historyDaysAgo(time_t now, int i) {
+    struct tm tm;
+    localtime_r(&now, &tm);
+    tm.tm_mday -= i;
+    tm.tm_hour = 12;                                            // Midday; nowhere near a day's ends
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+/***
+ * 
+ * historyPeriod    Return the rollup in ring (hours or days, of n periods each len seconds long) 
+ *                  for the period containing time t, starting it over if it's left from an 
+ *                  earlier go-around. If writable is false, returns NULL instead of starting over.
+ * 
+ ***/
+historyPeriod_t *historyPeriod(historyPeriod_t *ring, int n, int len, time_t t, bool writable) {
+    int64_t number;
+    int64_t start = historyStart(len, t, &number);
+    historyPeriod_t *per = &ring[number % n];
+    if (per->start != start) {
+        if (!writable) {
+            return NULL;
+        }
+        memset(per, 0, sizeof(*per));
+        per->start = start;
+    }
+    return per;
+}
+
+// Count value v in st
+void historyCount(historyStat_t *st, uint32_t v) {
+    st->count++;
+    st->sum += v;
+    st->max = v > st->max ? v : st->max;
+    st->bucket[histBucket(v)]++;
+}
+
+/***
+ * 
+ * historyNote  Add a measurement of metric (in the unit given in historyMetrics) for clip clipId 
+ *              (-1 if it isn't for a clip) to the current hour's and day's rollups. Called from 
+ *              any thread.
+ * 
+ ***/
+void historyNote(enum historyMetrics metric, int clipId, long long value) {
+    uint32_t v = value < 0 ? 0 : value > UINT32_MAX ? UINT32_MAX : value;
+    time_t now = time(NULL);
+    pthread_mutex_lock(&historyLock);
+    if (history == NULL) {                          // Not mapped, or unmapped at shutdown
+        pthread_mutex_unlock(&historyLock);
+        return;
+    }
+    int64_t dayNumber;
+    int64_t dayStart = historyStart(86400, now, &dayNumber);
+    int daySlot = dayNumber % HISTORY_DAYS;
+    if (history->day[daySlot].start != dayStart) {  // The day's about to start over; so do its clips' stats
+        memset(history->dayClip[daySlot], 0, sizeof(history->dayClip[daySlot]));
+    }
+    historyPeriod_t *hour = historyPeriod(history->hour, HISTORY_HOURS, 3600, now, true);
+    historyPeriod_t *day = historyPeriod(history->day, HISTORY_DAYS, 86400, now, true);
+    historyCount(&hour->all[metric], v);
+    historyCount(&day->all[metric], v);
+    if (clipId >= 0 && clipId < HISTORY_CLIPS && metric < HISTORY_CLIP_METRICS) {
+        historyClipStat_t *cs = &history->dayClip[daySlot][clipId][metric];
+        cs->count++;
+        cs->sum += v;
+        cs->max = v > cs->max ? v : cs->max;
+    }
+    pthread_mutex_unlock(&historyLock);
+}
+
+/***
+ * 
+ * historyReport    Print what history h says. what is "hours" or "days" for a trend over the 
+ *                  last n of them, "compare" to compare the last n days with the n before, or 
+ *                  "clips" for each clip over the last n days.
+ * 
+ ***/
+void historyReport(historyFile_t *h, const char *what, int n) {
+    static const char *metricName[HISTORY_METRICS] = {"switch", "first frame", "dropped", "link"};
+    static const double metricScale[HISTORY_METRICS] = {1000.0, 1000.0, 10.0, 1000.0};   // To ms, ms, %, ms
+    time_t now = time(NULL);
+    bool hours = strcmp(what, "hours") == 0;
+    if (hours || strcmp(what, "days") == 0) {
+        int len = hours ? 3600 : 86400;
+        printf("%-16s %7s %15s %15s %13s %15s\n", hours ? "hour" : "day", "clips", 
+            "switch p50/p95", "1st frm p50/p95", "dropped p95", "link p50/p95");
+        for (int i = n - 1; i >= 0; i--) {
+            historyPeriod_t *per = hours ? historyPeriod(h->hour, HISTORY_HOURS, len, now - i * len, false) : 
+                historyPeriod(h->day, HISTORY_DAYS, len, historyDaysAgo(now, i), false);
+            if (per == NULL || per->all[hmSwitch].count + per->all[hmLinkRtt].count == 0) {
+                continue;
+            }
+            char label[20];
+            time_t start = per->start;
+            strftime(label, sizeof(label), hours ? "%Y-%m-%d %H:00" : "%Y-%m-%d", localtime(&start));
+            printf("%-16s %7u %7.0f/%-7.0f %7.0f/%-7.0f %12.1f%% %7.0f/%-7.0f\n", label, per->all[hmSwitch].count, 
+                histPercentile(&per->all[hmSwitch], 0.5) / 1000.0, histPercentile(&per->all[hmSwitch], 0.95) / 1000.0, 
+                histPercentile(&per->all[hmFirstFrame], 0.5) / 1000.0, histPercentile(&per->all[hmFirstFrame], 0.95) / 1000.0, 
+                histPercentile(&per->all[hmDropped], 0.95) / 10.0, 
+                histPercentile(&per->all[hmLinkRtt], 0.5) / 1000.0, histPercentile(&per->all[hmLinkRtt], 0.95) / 1000.0);
+        }
+    } else if (strcmp(what, "compare") == 0) {
+        historyStat_t recent[HISTORY_METRICS], earlier[HISTORY_METRICS];
+        memset(recent, 0, sizeof(recent));
+        memset(earlier, 0, sizeof(earlier));
+        for (int i = 0; i < 2 * n && i < HISTORY_DAYS; i++) {
+            historyPeriod_t *per = historyPeriod(h->day, HISTORY_DAYS, 86400, historyDaysAgo(now, i), false);
+            for (int mNo = 0; per != NULL && mNo < HISTORY_METRICS; mNo++) {
+                histMerge(i < n ? &recent[mNo] : &earlier[mNo], &per->all[mNo]);
+            }
+        }
+        printf("Last %d days compared with the %d before (ms; dropped in %%)\n", n, n);
+        printf("%-12s %5s %10s %10s %8s\n", "", "", "before", "recent", "change");
+        for (int mNo = 0; mNo < HISTORY_METRICS; mNo++) {
+            static const double pct[] = {0.5, 0.9, 0.99};
+            static const char *pctName[] = {"p50", "p90", "p99"};
+            for (int pNo = 0; pNo < 3; pNo++) {
+                double was = histPercentile(&earlier[mNo], pct[pNo]) / metricScale[mNo];
+                double is = histPercentile(&recent[mNo], pct[pNo]) / metricScale[mNo];
+                printf("%-12s %5s %10.1f %10.1f", pNo == 0 ? metricName[mNo] : "", pctName[pNo], was, is);
+                if (was > 0.0) {
+                    printf(" %+7.0f%%", 100.0 * (is - was) / was);
+                }
+                printf("\n");
+            }
+            printf("%-12s %5s %10u %10u\n", "", "count", earlier[mNo].count, recent[mNo].count);
+        }
+    } else if (strcmp(what, "clips") == 0) {
+        printf("Last %d days\n%-20s %6s %15s %15s %13s\n", n, "clip", "plays", "switch avg/max", "1st frm avg/max", "dropped avg");
+        for (int cNo = 0; cNo < CLIP_COUNT && cNo < HISTORY_CLIPS; cNo++) {
+            historyClipStat_t sum[HISTORY_CLIP_METRICS];
+            memset(sum, 0, sizeof(sum));
+            for (int i = 0; i < n && i < HISTORY_DAYS; i++) {
+                historyPeriod_t *per = historyPeriod(h->day, HISTORY_DAYS, 86400, historyDaysAgo(now, i), false);
+                for (int mNo = 0; per != NULL && mNo < HISTORY_CLIP_METRICS; mNo++) {
+                    historyClipStat_t *cs = &h->dayClip[per - h->day][cNo][mNo];
+                    sum[mNo].count += cs->count;
+                    sum[mNo].sum += cs->sum;
+                    sum[mNo].max = cs->max > sum[mNo].max ? cs->max : sum[mNo].max;
+                }
+            }
+            if (sum[hmSwitch].count == 0) {
+                continue;
+            }
+            printf("%-20s %6u %7.0f/%-7.0f %7.0f/%-7.0f %12.1f%%\n", clips[cNo].name, sum[hmSwitch].count, 
+                sum[hmSwitch].sum / 1000.0 / sum[hmSwitch].count, sum[hmSwitch].max / 1000.0, 
+                sum[hmFirstFrame].count > 0 ? sum[hmFirstFrame].sum / 1000.0 / sum[hmFirstFrame].count : 0.0, 
+                sum[hmFirstFrame].max / 1000.0, 
+                sum[hmDropped].count > 0 ? sum[hmDropped].sum / 10.0 / sum[hmDropped].count : 0.0);
+        }
+    } else {
+        puts("history needs hours, days, compare or clips.");
+    }
+}
+
+/***
+ * 
+ * sfxWriter    Thread that plays sound effect opaque (an sfxPlayer_t) each time it's triggered. 
+ *              The samples go to the device SFX_CHUNK frames at a time so that a new trigger 
+ *              cuts the play going off and starts it again from the beginning.
+ * 
+ ***/
+void *sfxWriter(void *opaque) {
+    sfxPlayer_t *sp = opaque;
+    prctl(PR_SET_NAME, "sfx");
+    while (true) {
+        pthread_mutex_lock(&sfxLock);
+        while (!atomic_load(&sp->restart)) {
+            pthread_cond_wait(&sfxTriggered, &sfxLock);
+        }
+        atomic_store(&sp->restart, false);
+        long long triggerMicros = sp->triggerMicros;
+        pthread_mutex_unlock(&sfxLock);
+
+        snd_pcm_drop(sp->pcm);                                  // Cut off what's left of the last play
+        snd_pcm_prepare(sp->pcm);
+        bool first = true;
+        snd_pcm_uframes_t done = 0;
+        while (done < sp->frames && !atomic_load(&sp->restart)) {
+            snd_pcm_uframes_t count = sp->frames - done;
+            if (count > SFX_CHUNK) {
+                count = SFX_CHUNK;
+            }
+            snd_pcm_sframes_t n = snd_pcm_writei(sp->pcm, sp->samples + done * sp->channels, count);
+            if (n < 0) {
+                if (snd_pcm_recover(sp->pcm, n, 1) < 0) {        // Can't recover; drop the rest
+                    break;
+                }
+                continue;
+            }
+            if (first) {
+                first = false;
+                printf("Sound effect %s first heard %lld us after it was triggered.\n", 
+                    sfx[sp - sfxPlayer].name, microsNow() - triggerMicros);
+            }
+            done += n;
+        }
+    }
+    return NULL;
+}
+
+/***
+ * 
+ * wavLe16, wavLe32     The little-endian 16- or 32-bit number at p in a .wav file
+ * 
+ ***/
+unsigned wavLe16(const unsigned char *p) {
+    return p[0] | p[1] << 8;
+}
+
+unsigned wavLe32(const unsigned char *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (unsigned)p[3] << 24;
+}
+
+/***
+ * 
+ * loadSfx  Decode the sound effects into memory, open a handle on the audio device for each 
+ *          and start the thread that plays it. A sound effect that can't be loaded is reported 
+ *          and left unavailable; the exhibit can run without it.
+ * 
+ ***/
+void loadSfx() {
+    for (int sNo = 0; sNo < SFX_COUNT; sNo++) {
+        char path[sizeof(MEDIA_PATH) + CLIP_FILE_MAX] = MEDIA_PATH;
+        strcat(path, sfx[sNo].file);
+        FILE *f = fopen(path, "rb");
+        if (f == NULL) {
+            printf("Failed to open sound effect %s. Error: %s\n", path, strerror(errno));
+            continue;
+        }
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        rewind(f);
+        unsigned char *data = malloc(size > 0 ? size : 1);
+        if (size <= 0 || data == NULL || fread(data, 1, size, f) != size) {
+            printf("Failed to read sound effect %s.\n", path);
+            free(data);
+            fclose(f);
+            continue;
+        }
+        fclose(f);
+
+        // Find the format and the samples among the file's chunks
+        unsigned channels = 0, rate = 0, bits = 0, format = 0;
+        unsigned char *pcmData = NULL;
+        unsigned pcmBytes = 0;
+        if (size >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVE", 4) == 0) {
+            long at = 12;
+            while (at + 8 <= size) {
+                unsigned chunkBytes = wavLe32(data + at + 4);
+                if (chunkBytes > size - at - 8) {                   // Truncated file; take what's there
+                    chunkBytes = size - at - 8;
+                }
+                if (memcmp(data + at, "fmt ", 4) == 0 && chunkBytes >= 16) {
+                    format = wavLe16(data + at + 8);
+                    channels = wavLe16(data + at + 10);
+                    rate = wavLe32(data + at + 12);
+                    bits = wavLe16(data + at + 22);
+                } else if (memcmp(data + at, "data", 4) == 0) {
+                    pcmData = data + at + 8;
+                    pcmBytes = chunkBytes;
+                }
+                at += 8 + chunkBytes + (chunkBytes & 1);            // Chunks are padded to even lengths
+            }
+        }
+        // Format 1 is plain PCM; 0xFFFE (extensible) carries it too
+        if ((format != 1 && format != 0xFFFE) || bits != 16 || channels == 0 || rate == 0 || pcmData == NULL) {
+            printf("Sound effect %s isn't a 16-bit PCM .wav file.\n", path);
+            free(data);
+            continue;
+        }
+        sfxPlayer[sNo].channels = channels;
+        sfxPlayer[sNo].frames = pcmBytes / (channels * sizeof(int16_t));
+        sfxPlayer[sNo].samples = malloc(sfxPlayer[sNo].frames * channels * sizeof(int16_t) + 1);
+        if (sfxPlayer[sNo].samples == NULL) {
+            printf("Failed to allocate memory for sound effect %s.\n", path);
+            free(data);
+            continue;
+        }
+        memcpy(sfxPlayer[sNo].samples, pcmData, sfxPlayer[sNo].frames * channels * sizeof(int16_t));
+        free(data);
+
+        int err = snd_pcm_open(&sfxPlayer[sNo].pcm, AUDIO_DEVICE, SND_PCM_STREAM_PLAYBACK, 0);
+        if (err >= 0) {                                         // The effect's own rate and channels; no converting
+            err = snd_pcm_set_params(sfxPlayer[sNo].pcm, SND_PCM_FORMAT_S16, SND_PCM_ACCESS_RW_INTERLEAVED, 
+                channels, rate, 1, audioBufferMs * 1000);
+        }
+        pthread_t t;
+        if (err >= 0 && pthread_create(&t, NULL, sfxWriter, &sfxPlayer[sNo]) == 0) {
+            pthread_detach(t);
+            continue;
+        }
+        if (err < 0) {
+            printf("Failed to open %s for sound effect %s. Error: %s\n", AUDIO_DEVICE, sfx[sNo].name, 
+                snd_strerror(err));
+        } else {
+            printf("Failed to start the thread for sound effect %s.\n", sfx[sNo].name);
+        }
+        if (sfxPlayer[sNo].pcm != NULL) {
+            snd_pcm_close(sfxPlayer[sNo].pcm);
+            sfxPlayer[sNo].pcm = NULL;
+        }
+        free(sfxPlayer[sNo].samples);
+        sfxPlayer[sNo].samples = NULL;
+    }
+}
+
+/***
+ * 
+ * blendRowScalar   Blend n bytes of a and b into dst: dst = (a * (256 - alpha) + b * alpha) / 256,
+ *                  where alpha is 0 .. 256. Plain C, for the tails of rows and for platforms 
+ *                  without SIMD.
+ * 
+ ***/
+void blendRowScalar(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t n, unsigned alpha) {
+    unsigned beta = 256 - alpha;
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = (a[i] * beta + b[i] * alpha) >> 8;
+    }
+}
+
+/***
+ * 
+ * blendRow     Same as blendRowScalar but using whatever SIMD instructions the build allows.
+ *              All the arithmetic is done in 16-bit lanes; 255 * 256 fits.
+ * 
+ ***/
+void blendRow(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t n, unsigned alpha) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    uint16x8_t va = vdupq_n_u16(alpha);
+    uint16x8_t vb = vdupq_n_u16(256 - alpha);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t x = vld1q_u8(a + i);
+        uint8x16_t y = vld1q_u8(b + i);
+        uint16x8_t lo = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(x)), vb), vmovl_u8(vget_low_u8(y)), va);
+        uint16x8_t hi = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(x)), vb), vmovl_u8(vget_high_u8(y)), va);
+        vst1q_u8(dst + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+    }
+#else
+#if defined(__AVX2__)
+    __m256i wa = _mm256_set1_epi16(alpha);
+    __m256i wb = _mm256_set1_epi16(256 - alpha);
+    __m256i zero = _mm256_setzero_si256();
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(x, zero), wb), 
+                                      _mm256_mullo_epi16(_mm256_unpacklo_epi8(y, zero), wa));
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(x, zero), wb), 
+                                      _mm256_mullo_epi16(_mm256_unpackhi_epi8(y, zero), wa));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i sa = _mm_set1_epi16(alpha);
+    __m128i sb = _mm_set1_epi16(256 - alpha);
+    __m128i szero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(x, szero), sb), 
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(y, szero), sa));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(x, szero), sb), 
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(y, szero), sa));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+#endif
+#endif
+    blendRowScalar(dst + i, a + i, b + i, n - i, alpha);
+}
+
+/***
+ * 
+ * compPresent  Put the current frame on the screen. Called from the display callback of deck d. 
+ *              Only the active deck drives the display. While a crossfade is in progress, the 
+ *              frame shown is a blend of the other deck's last frame and d's latest one. The fade 
+ *              is timed from d's first frame so that the time VLC takes to open the new clip 
+ *              doesn't eat into it.
+ * 
+ ***/
+void compPresent(deck_t *d) {
+    pthread_mutex_lock(&compLock);                              // No swap, and no other deck presenting, till we're done
+    int active = activeDeck;
+    if (d != &deck[active] || fb == NULL) {
+        pthread_mutex_unlock(&compLock);
+        return;
+    }
+    unsigned alpha = 256;
+    if (fading) {
+        long long now = microsNow();
+        if (fadeStartMicros == 0) {
+            fadeStartMicros = now;
+        }
+        long long elapsed = now - fadeStartMicros;
+        if (crossfadeMs <= 0 || elapsed >= crossfadeMs * 1000LL) {
+            fading = false;
+            postEvent(evFadeDone, active);                      // So main loop can retire the old deck
+        } else {
+            alpha = elapsed * 256 / (crossfadeMs * 1000LL);
+        }
+    }
+    deck_t *old = &deck[1 - active];
+    size_t rowBytes = fbWidth * 4;
+    pthread_mutex_lock(&d->lock);
+    if (alpha < 256) {
+        pthread_mutex_lock(&old->lock);
+        for (unsigned y = 0; y < fbHeight; y++) {
+            blendRow(fb + y * fbStride, old->buf[old->front] + y * rowBytes, d->buf[d->front] + y * rowBytes, rowBytes, alpha);
+        }
+        pthread_mutex_unlock(&old->lock);
+    } else {
+        for (unsigned y = 0; y < fbHeight; y++) {
+            memcpy(fb + y * fbStride, d->buf[d->front] + y * rowBytes, rowBytes);
+        }
+    }
+    pthread_mutex_unlock(&d->lock);
+    pthread_mutex_unlock(&compLock);
+}
+
+/***
+ * 
+ * Video callbacks used by VLC to decode into a deck's frame buffers
+ * 
+ ***/
+void *deckLock(void *opaque, void **planes) {
+    deck_t *d = opaque;
+    planes[0] = d->buf[1 - d->front];                           // Decode into the back buffer
+    return NULL;
+}
+
+void deckDisplay(void *opaque, void *picture) {
+    deck_t *d = opaque;
+    long long from = overlayShownFrom;
+    if (from != 0 && d == &deck[activeDeck]) {                  // First frame since the overlay changed
+        overlayShownFrom = 0;
+        long long took = microsNow() - from;
+        overlayShownTotalMicros += took;
+        if (took > overlayShownMaxMicros) {
+            overlayShownMaxMicros = took;
+        }
+        overlayShown++;
+    }
+    pthread_mutex_lock(&d->lock);
+    d->front = 1 - d->front;
+    pthread_mutex_unlock(&d->lock);
+    compPresent(d);
+}
+
+/***
+ * 
+ * compInit     Open and map the framebuffer and set up the two decks. Returns RET_OK or the 
+ *              return code main should exit with.
+ * 
+ ***/
+int compInit() {
+    int fd = open(FB_DEVICE, O_RDWR);
+    if (fd < 0) {
+        printf("Failed to open %s. Error: %s\n", FB_DEVICE, strerror(errno));
+        return RET_OFBF;
+    }
+    struct fb_var_screeninfo vinfo;
+    struct fb_fix_screeninfo finfo;
+    if (ioctl(fd, FBIOGET_VSCREENINFO, &vinfo) != 0 || ioctl(fd, FBIOGET_FSCREENINFO, &finfo) != 0) {
+        printf("Failed to get %s screen info. Error: %s\n", FB_DEVICE, strerror(errno));
+        close(fd);
+        return RET_OFBF;
+    }
+    if (vinfo.bits_per_pixel != 32) {
+        printf("Compositor needs a 32 bpp framebuffer; %s is %u bpp.\n", FB_DEVICE, vinfo.bits_per_pixel);
+        close(fd);
+        return RET_OFBF;
+    }
+    fbWidth = vinfo.xres;
+    fbHeight = vinfo.yres;
+    fbStride = finfo.line_length;
+    fbSize = (size_t)fbStride * fbHeight;
+    fb = mmap(NULL, fbSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);                                                  // The mapping stays valid
+    if (fb == MAP_FAILED) {
+        fb = NULL;
+        printf("Failed to map %s. Error: %s\n", FB_DEVICE, strerror(errno));
+        return RET_OFBF;
+    }
+    memset(fb, 0, fbSize);
+
+    for (int dNo = 0; dNo < 2; dNo++) {
+        deck[dNo].mp = libvlc_media_player_new(inst);
+        if (deck[dNo].mp == NULL) {
+            puts("Failed to create media player");
+            return RET_MPCF;
+        }
+        for (int bNo = 0; bNo < 2; bNo++) {
+            deck[dNo].buf[bNo] = calloc((size_t)fbWidth * fbHeight, 4);
+            if (deck[dNo].buf[bNo] == NULL) {
+                puts("Failed to allocate compositor frame buffers");
+                return RET_MPCF;
+            }
+        }
+        pthread_mutex_init(&deck[dNo].lock, NULL);
+        libvlc_video_set_callbacks(deck[dNo].mp, deckLock, NULL, deckDisplay, &deck[dNo]);
+        libvlc_video_set_format(deck[dNo].mp, "RV32", fbWidth, fbHeight, fbWidth * 4);
+    }
+    printf("Compositor drawing on %s at %ux%u.\n", FB_DEVICE, fbWidth, fbHeight);
+    return RET_OK;
+}
+
+/***
+ * 
+ * compSwapDecks    Switch to the other deck, so the next clip starts there, and begin a crossfade 
+ *                  away from the deck that's been in use. Called by main loop just before it 
+ *                  starts a clip.
+ * 
+ ***/
+void compSwapDecks() {
+    pthread_mutex_lock(&compLock);
+    int active = 1 - activeDeck;
+    deck[1 - active].needsStop = true;
+    deck[active].needsStop = false;
+    mp = deck[active].mp;
+    fadeStartMicros = 0;
+    fading = crossfadeMs > 0;
+    activeDeck = active;
+    pthread_mutex_unlock(&compLock);
+}
+
+/***
+ * 
+ * compReap     Stop the retired deck's player once the crossfade away from it is done. This can't 
+ *              be done from the video callbacks since libVLC may not be called from its own threads,
+ *              so compPresent() posts an evFadeDone and main loop does it.
+ * 
+ ***/
+void compReap() {
+    deck_t *old = &deck[1 - activeDeck];
+    if (!fading && old->needsStop) {
+        old->needsStop = false;
+        libvlc_media_player_stop(old->mp);
+    }
+}
+
+/***
+ * 
+ * libVLC event handler for a clip player's position changing. The first change after a clip switch 
+ * means the clip's first frame is up. Completes the seek in flight, if any, once the position is 
+ * nearer its target than where it started, and accounts for how long it took. opaque is the 
+ * player's deck number.
+ * 
+ ***/
+void onPositionChanged(const libvlc_event_t *e, void *opaque) {
+    if ((int)(intptr_t)opaque != activeDeck) {
+        return;
+    }
+    if (framePending) {                                         // The first frame of a new clip is up
+        framePending = false;
+        historyNote(hmFirstFrame, switchClipId, microsNow() - switchMicros);
+    }
+    float pos = e->u.media_player_position_changed.new_position;
+    lastPosition = pos;
+    if (seekInFlight && fabsf(pos - scrubTarget) < fabsf(pos - seekFrom)) {
+        long long latency = microsNow() - seekRequestMicros;
+        seekTotalMicros += latency;
+        if (latency > seekMaxMicros) {
+            seekMaxMicros = latency;
+        }
+        seekCount++;
+        seekInFlight = false;
+        postEvent(evSeekDone, 0);
+    }
+}
+
+/***
+ * 
+ * libVLC event handler for the clip player events main loop cares about. opaque is the player's 
+ * deck number; events from a deck other than the active one are old news and are ignored.
+ * 
+ ***/
+void onPlayerEvent(const libvlc_event_t *e, void *opaque) {
+    if ((int)(intptr_t)opaque != activeDeck) {
+        return;
+    }
+    switch (e->type) {
+        case libvlc_MediaPlayerPlaying:
+            if (firstFrameMicros == 0) {
+                firstFrameMicros = microsNow();
+            }
+            if (playPending) {
+                playPending = false;
+                long long took = microsNow() - switchMicros;
+                historyNote(hmSwitch, switchClipId, took);
+                if (switchPrefetch == pfHit) {
+                    hitSwitchMicros += took;
+                    hitSwitches++;
+                } else if (switchPrefetch == pfMiss) {
+                    missSwitchMicros += took;
+                    missSwitches++;
+                }
+                switchTotalMicros += took;
+                if (took > switchMaxMicros) {
+                    switchMaxMicros = took;
+                }
+            }
+            postEvent(evPlaying, 0);
+            break;
+        case libvlc_MediaPlayerEndReached:
+            postEvent(evClipEnd, 0);
+            break;
+        case libvlc_MediaPlayerEncounteredError:
+            postEvent(evClipEnd, 1);
+            break;
+        case libvlc_MediaPlayerESAdded:
+            if (e->u.media_player_es_changed.i_type == libvlc_track_audio) {
+                postEvent(evAudioTrack, e->u.media_player_es_changed.i_id);
+            }
+            break;
+        case libvlc_MediaPlayerESSelected:
+            if (e->u.media_player_es_changed.i_type == libvlc_track_audio && langPending) {
+                langPending = false;
+                long long took = microsNow() - langRequestMicros;
+                langTotalMicros += took;
+                if (took > langMaxMicros) {
+                    langMaxMicros = took;
+                }
+                langSwitches++;
+            }
+            break;
+    }
+}
+
+/***
+ * 
+ * libVLC event handler for a clip player's number of video outputs changing. A new video output 
+ * right after a clip switch means the switch had to set one up; account for how long that took.
+ * 
+ ***/
+void onVoutEvent(const libvlc_event_t *e, void *opaque) {
+    if ((int)(intptr_t)opaque != activeDeck) {
+        return;
+    }
+    if (e->u.media_player_vout.new_count > 0 && voutPending) {
+        voutPending = false;
+        long long setup = microsNow() - switchMicros;
+        voutTotalMicros += setup;
+        if (setup > voutMaxMicros) {
+            voutMaxMicros = setup;
+        }
+        voutCount++;
+    }
+}
+
+/***
+ * 
+ * libVLC event handler for the clip player events we trace. opaque is the player's deck number.
+ * 
+ ***/
+void onTraceVlcEvent(const libvlc_event_t *e, void *opaque) {
+    const char *name;
+    switch (e->type) {
+        case libvlc_MediaPlayerPlaying:         name = "Playing"; break;
+        case libvlc_MediaPlayerPaused:          name = "Paused"; break;
+        case libvlc_MediaPlayerStopped:         name = "Stopped"; break;
+        case libvlc_MediaPlayerEndReached:      name = "EndReached"; break;
+        case libvlc_MediaPlayerEncounteredError: name = "EncounteredError"; break;
+        case libvlc_MediaPlayerVout:            name = "Vout"; break;
+        default:                                name = "Other"; break;
+    }
+    traceEvent(trVlcEvent, name, (int)(intptr_t)opaque, e->type);
+}
+
+/***
+ * 
+ * attachPlayerEvents   Attach our libVLC event handlers to the clip player p, which is deck 
+ *                      number deckNo (always 0 without the compositor).
+ * 
+ ***/
+void attachPlayerEvents(libvlc_media_player_t *p, int deckNo) {
+    static const libvlc_event_type_t traced[] = {
+        libvlc_MediaPlayerPlaying, libvlc_MediaPlayerPaused, libvlc_MediaPlayerStopped, 
+        libvlc_MediaPlayerEndReached, libvlc_MediaPlayerEncounteredError, libvlc_MediaPlayerVout
+    };
+    libvlc_event_manager_t *em = libvlc_media_player_event_manager(p);
+    libvlc_event_attach(em, libvlc_MediaPlayerPositionChanged, onPositionChanged, (void *)(intptr_t)deckNo);
+    for (int i = 0; i < sizeof(traced) / sizeof(traced[0]); i++) {
+        libvlc_event_attach(em, traced[i], onTraceVlcEvent, (void *)(intptr_t)deckNo);
+    }
+    libvlc_event_attach(em, libvlc_MediaPlayerPlaying, onPlayerEvent, (void *)(intptr_t)deckNo);
+    libvlc_event_attach(em, libvlc_MediaPlayerEndReached, onPlayerEvent, (void *)(intptr_t)deckNo);
+    libvlc_event_attach(em, libvlc_MediaPlayerEncounteredError, onPlayerEvent, (void *)(intptr_t)deckNo);
+    libvlc_event_attach(em, libvlc_MediaPlayerESAdded, onPlayerEvent, (void *)(intptr_t)deckNo);
+    libvlc_event_attach(em, libvlc_MediaPlayerESSelected, onPlayerEvent, (void *)(intptr_t)deckNo);
+    libvlc_event_attach(em, libvlc_MediaPlayerVout, onVoutEvent, (void *)(intptr_t)deckNo);
+}
+
+/***
+ * 
+ * surfaceInit  Make the window the clips are shown in and tell the clip player p to draw in it. 
+ *              Returns RET_OK or the return code main should exit with. Without 
+ *              PERSISTENT_SURFACE, there's nothing to do; VLC makes its own windows. If there's 
+ *              no X display to make ours on, VLC is left to make its own too, so the exhibit 
+ *              still shows video, just with a flash at each clip switch.
+ * 
+ ***/
+int surfaceInit(libvlc_media_player_t *p) {
+    #ifdef PERSISTENT_SURFACE
+    xDisplay = XOpenDisplay(NULL);
+    if (xDisplay == NULL) {
+        puts("Warning: failed to open X display for the video surface. Is DISPLAY set? Letting VLC make its own windows.");
+        libvlc_set_fullscreen(p, isFullscreen);
+        return RET_OK;
+    }
+    int screen = DefaultScreen(xDisplay);
+    xWindow = XCreateSimpleWindow(xDisplay, RootWindow(xDisplay, screen), 0, 0, 
+        WINDOW_WIDTH, WINDOW_HEIGHT, 0, BlackPixel(xDisplay, screen), BlackPixel(xDisplay, screen));
+    XStoreName(xDisplay, xWindow, "MediaPlayer");
+    if (isFullscreen) {                             // Ask to start out fullscreen, before it's ever shown
+        Atom state = XInternAtom(xDisplay, "_NET_WM_STATE", False);
+        Atom full = XInternAtom(xDisplay, "_NET_WM_STATE_FULLSCREEN", False);
+        XChangeProperty(xDisplay, xWindow, state, XA_ATOM, 32, PropModeReplace, (unsigned char *)&full, 1);
+    }
+    XMapWindow(xDisplay, xWindow);
+    XFlush(xDisplay);
+    libvlc_media_player_set_xwindow(p, xWindow);
+    #endif
+    return RET_OK;
+}
+
+/***
+ * 
+ * setFullscreen    Put the video in fullscreen mode or take it out. With PERSISTENT_SURFACE, the 
+ *                  window manager resizes our window and VLC's output follows along; otherwise 
+ *                  VLC switches between its own windows.
+ * 
+ ***/
+void setFullscreen(bool full) {
+    #if defined(PERSISTENT_SURFACE)
+    if (xDisplay == NULL) {                         // No window of our own; VLC has its own
+        libvlc_set_fullscreen(mp, full);
+        return;
+    }
+    XEvent xe;
+    memset(&xe, 0, sizeof(xe));
+    xe.xclient.type = ClientMessage;
+    xe.xclient.window = xWindow;
+    xe.xclient.message_type = XInternAtom(xDisplay, "_NET_WM_STATE", False);
+    xe.xclient.format = 32;
+    xe.xclient.data.l[0] = full ? 1 : 0;            // _NET_WM_STATE_ADD or _NET_WM_STATE_REMOVE
+    xe.xclient.data.l[1] = XInternAtom(xDisplay, "_NET_WM_STATE_FULLSCREEN", False);
+    xe.xclient.data.l[3] = 1;                       // Request comes from a normal application
+    XSendEvent(xDisplay, DefaultRootWindow(xDisplay), False, SubstructureRedirectMask | SubstructureNotifyMask, &xe);
+    XFlush(xDisplay);
+    #elif !defined(COMPOSITOR)
+    libvlc_set_fullscreen(mp, full);
+    #endif
+}
+
+#ifdef PERSISTENT_AUDIO
+/***
+ * 
+ * audioWrite   Write count frames from samples to the audio device. A write that finds the device 
+ *              has run dry is a dropout, except in the first buffer after a clip switch (first), 
+ *              since the device is expected to run dry between clips.
+ * 
+ ***/
+void audioWrite(const void *samples, unsigned count, bool first) {
+    const char *next = samples;
+    while (count > 0) {
+        snd_pcm_sframes_t n = snd_pcm_writei(pcm, next, count);
+        if (n < 0) {
+            if (n == -EPIPE && !first) {
+                audioUnderruns++;
+                clipUnderruns++;
+            }
+            if (snd_pcm_recover(pcm, n, 1) < 0) {               // Can't recover; drop the rest
+                return;
+            }
+            continue;
+        }
+        next += n * AUDIO_CHANNELS * sizeof(int16_t);
+        count -= n;
+    }
+}
+
+/***
+ * 
+ * Audio callbacks used by VLC to hand a clip player's decoded sound to the audio device. opaque is 
+ * the player's deck number. Only the active deck is heard; during a crossfade the old clip's 
+ * sound just stops. VLC hands sound over as soon as it's decoded, so audioPlay() puts each buffer 
+ * on time itself: pts is when it's due on libvlc_clock()'s time base, and it will be heard once 
+ * what the device already has queued has played.
+ * 
+ ***/
+void audioPlay(void *opaque, const void *samples, unsigned count, int64_t pts) {
+    static const int16_t silence[AUDIO_RATE / 100 * AUDIO_CHANNELS];   // 10 ms of it
+    if ((int)(intptr_t)opaque != activeDeck) {
+        return;
+    }
+    bool first = audioPending;
+    if (first) {
+        audioPending = false;
+        long long took = microsNow() - switchMicros;
+        audioStartTotalMicros += took;
+        if (took > audioStartMaxMicros) {
+            audioStartMaxMicros = took;
+        }
+        audioStarts++;
+    }
+    if (pts > 0) {
+        snd_pcm_sframes_t queued;
+        if (snd_pcm_delay(pcm, &queued) < 0 || queued < 0) {     // Not running, e.g. just after a switch
+            queued = 0;
+        }
+        long long late = libvlc_clock() + queued * 1000000LL / AUDIO_RATE - pts;
+        long long off = late < 0 ? -late : late;
+        if (off > audioOffsetMaxMicros) {
+            audioOffsetMaxMicros = off;
+        }
+        if (late < -AUDIO_SYNC_MS * 1000LL) {                   // Early: hold it back, a buffer's worth at most
+            unsigned most = audioBufferMs * AUDIO_RATE / 1000;
+            unsigned pad = -late * AUDIO_RATE / 1000000;
+            if (pad > most) {
+                pad = most;
+            }
+            audioPadFrames += pad;
+            while (pad > 0) {
+                unsigned n = pad < AUDIO_RATE / 100 ? pad : AUDIO_RATE / 100;
+                audioWrite(silence, n, first);
+                pad -= n;
+            }
+        } else if (late > AUDIO_SYNC_MS * 1000LL) {             // Late: skip what's already past
+            unsigned drop = late * AUDIO_RATE / 1000000;
+            if (drop > count) {
+                drop = count;
+            }
+            audioDropFrames += drop;
+            samples = (const char *)samples + drop * AUDIO_CHANNELS * sizeof(int16_t);
+            count -= drop;
+        }
+    }
+    audioWrite(samples, count, first);
+}
+
+void audioPause(void *opaque, int64_t pts) {
+    if ((int)(intptr_t)opaque == activeDeck) {
+        snd_pcm_pause(pcm, 1);                                  // Not all devices can; those just run dry
+    }
+}
+
+void audioResume(void *opaque, int64_t pts) {
+    if ((int)(intptr_t)opaque == activeDeck) {
+        snd_pcm_pause(pcm, 0);
+    }
+}
+
+void audioFlush(void *opaque, int64_t pts) {
+    if ((int)(intptr_t)opaque == activeDeck) {
+        snd_pcm_drop(pcm);                                      // Discard what's buffered but keep the device open
+        snd_pcm_prepare(pcm);
+    }
+}
+#endif
+
+/***
+ * 
+ * audioInit    Open the audio device the clips' sound goes to. Returns RET_OK or the return code 
+ *              main should exit with. Without PERSISTENT_AUDIO, there's nothing to do; VLC opens 
+ *              the device itself for each clip. If the device can't be opened, VLC is left to 
+ *              open its own output for each clip too, so the exhibit still has sound.
+ * 
+ ***/
+int audioInit() {
+    char *ms = getenv("MP_AUDIO_BUFFER_MS");
+    if (ms != NULL && atoi(ms) > 0) {
+        audioBufferMs = atoi(ms);
+    }
+    #ifdef PERSISTENT_AUDIO
+    int err = snd_pcm_open(&pcm, AUDIO_DEVICE, SND_PCM_STREAM_PLAYBACK, 0);
+    if (err >= 0) {
+        err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16, SND_PCM_ACCESS_RW_INTERLEAVED, AUDIO_CHANNELS, 
+            AUDIO_RATE, 1, audioBufferMs * 1000);
+    }
+    if (err < 0) {
+        printf("Warning: failed to open audio device %s. Error: %s. Letting VLC open its own output.\n", 
+            AUDIO_DEVICE, snd_strerror(err));
+        if (pcm != NULL) {
+            snd_pcm_close(pcm);
+            pcm = NULL;
+        }
+    }
+    #endif
+    return RET_OK;
+}
+
+/***
+ * 
+ * attachAudio  Have the clip player p, which is deck number deckNo, send its sound to the audio 
+ *              device opened by audioInit(). If it isn't open, p keeps VLC's own audio output.
+ * 
+ ***/
+void attachAudio(libvlc_media_player_t *p, int deckNo) {
+    #ifdef PERSISTENT_AUDIO
+    if (pcm == NULL) {
+        return;
+    }
+    libvlc_audio_set_callbacks(p, audioPlay, audioPause, audioResume, audioFlush, NULL, (void *)(intptr_t)deckNo);
+    libvlc_audio_set_format(p, "S16N", AUDIO_RATE, AUDIO_CHANNELS);
+    #endif
+}
+
+/***
+ * 
+ * readSysfs    Read the first line of the file at path and parse it as an integer in the given 
+ *              base. Returns true if that worked.
+ * 
+ ***/
+bool readSysfs(const char *path, int base, long *value) {
+    char line[32];
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+    if (ok) {
+        char *end;
+        *value = strtol(line, &end, base);
+        ok = end != line;
+    }
+    return ok;
+}
+
+/***
+ * 
+ * noteDroppedFrames    Account for the frames displayed and dropped during the latest play of 
+ *                      rendition r of clip clipId. If that play was started from a pre-rolled 
+ *                      copy of the media item, the counts are the copy's, and it's let go of.
+ * 
+ ***/
+void noteDroppedFrames(int clipId, int r) {
+    libvlc_media_stats_t st;
+    int displayed, lost;
+    libvlc_media_t *copy = nowPlayingCopy;
+    nowPlayingCopy = NULL;
+    if (copy != NULL) {                                             // Pre-rolled: the copy counted only this play
+        bool ok = libvlc_media_get_stats(copy, &st);
+        libvlc_media_release(copy);
+        if (r < 0 || !ok) {
+            return;
+        }
+        displayed = st.i_displayed_pictures;
+        lost = st.i_lost_pictures;
+        audioLost += st.i_lost_abuffers;
+    } else {
+        if (r < 0 || m[clipId][r] == NULL || !libvlc_media_get_stats(m[clipId][r], &st)) {
+            return;
+        }
+        displayed = st.i_displayed_pictures - lastDisplayed[clipId][r];
+        lost = st.i_lost_pictures - lastLost[clipId][r];
+        if (displayed < 0 || lost < 0) {                            // libVLC started counting over
+            displayed = st.i_displayed_pictures;
+            lost = st.i_lost_pictures;
+        }
+        lastDisplayed[clipId][r] = st.i_displayed_pictures;
+        lastLost[clipId][r] = st.i_lost_pictures;
+        int lostAudio = st.i_lost_abuffers - lastLostAudio[clipId][r];
+        audioLost += lostAudio < 0 ? st.i_lost_abuffers : lostAudio;
+        lastLostAudio[clipId][r] = st.i_lost_abuffers;
+    }
+    if (displayed + lost == 0) {
+        return;
+    }
+    renditionDisplayed[r] += displayed;
+    renditionLost[r] += lost;
+    historyNote(hmDropped, clipId, 1000LL * lost / (displayed + lost));
+    recentDropRate = DROP_WEIGHT * lost / (displayed + lost) + (1.0 - DROP_WEIGHT) * recentDropRate;
+    #ifdef DEBUG
+    printf("Clip %d (%s) rendition %d dropped %d of %d frames.\n", clipId, clips[clipId].name, r, lost, displayed + lost);
+    #endif
+}
+
+/***
+ * 
+ * pickRendition    Pick the rendition of clip clipId to play. Each sign of trouble -- recent 
+ *                  dropped frames, high CPU load, high temperature -- steps down one rendition; 
+ *                  active throttling steps down two. Only renditions whose files are there are 
+ *                  picked. Returns the index of the rendition and, if report, logs the choice.
+ * 
+ ***/
+int pickRendition(int clipId, bool report) {
+    int usable[RENDITION_MAX];                                  // Indices of the renditions actually on the card
+    int available = 0;
+    for (int r = 0; r < RENDITION_MAX; r++) {
+        if (m[clipId][r] != NULL) {
+            usable[available++] = r;
+        }
+    }
+    if (available <= 1) {
+        return 0;
+    }
+
+    const char *thermalPath = getenv("MP_THERMAL_PATH") != NULL ? getenv("MP_THERMAL_PATH") : THERMAL_PATH;
+    const char *throttlePath = getenv("MP_THROTTLE_PATH") != NULL ? getenv("MP_THROTTLE_PATH") : THROTTLE_PATH;
+    long milliC = 0;
+    long throttled = 0;
+    double load = 0.0;
+    readSysfs(thermalPath, 10, &milliC);
+    readSysfs(throttlePath, 16, &throttled);
+    if (getloadavg(&load, 1) == 1) {
+        load /= sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    int stepDown = 0;
+    stepDown += recentDropRate > DROP_HIGH;
+    stepDown += load > LOAD_HIGH;
+    stepDown += milliC > TEMP_HOT_MC;
+    stepDown += (throttled & THROTTLE_NOW) ? 2 : 0;
+    int r = usable[stepDown < available ? stepDown : available - 1];
+    if (report) {
+        printf("Rendition %d (%s) for clip %d: dropped %.1f%%, load %.2f, %.1f C, throttle flags 0x%lx\n", 
+            r, clips[clipId].file[r], clipId, 100.0 * recentDropRate, load, milliC / 1000.0, throttled);
+    }
+    return r;
+}
+
+/***
+ * 
+ * chooseRendition  Pick the rendition of clip clipId to start playing now, and say which and why
+ * 
+ ***/
+int chooseRendition(int clipId) {
+    return pickRendition(clipId, true);
+}
+
+/***
+ * 
+ * libVLC log handler. Decides whether to keep the message and, if so, puts it in the VLC log 
+ * ring. Called on whatever VLC thread logged the message, so it must not block.
+ * 
+ ***/
+void onVlcLog(void *data, int level, const libvlc_log_t *ctx, const char *fmt, va_list args) {
+    const char *module = NULL, *file = NULL;
+    unsigned line;
+    libvlc_log_get_context(ctx, &module, &file, &line);
+    if (module == NULL) {
+        module = "?";
+    }
+    int minLevel = vlcLogLevel;
+    for (int i = 0; i < VLCLOG_FILTERS; i++) {
+        if (vlcLogFilter[i].module[0] != '\0' && strcmp(vlcLogFilter[i].module, module) == 0) {
+            minLevel = vlcLogFilter[i].level;
+            break;
+        }
+    }
+    if (level < minLevel) {
+        return;
+    }
+
+    long long now = microsNow();
+    long long second = now / 1000000;
+    long long was = atomic_load(&vlcLogSecond);
+    if (second != was && atomic_compare_exchange_strong(&vlcLogSecond, &was, second)) {
+        atomic_store(&vlcLogInSecond, 0);                       // First message in a new second
+    }
+    if (atomic_fetch_add(&vlcLogInSecond, 1) >= VLCLOG_RATE) {
+        atomic_fetch_add(&vlcLogDropped, 1);
+        return;
+    }
+
+    unsigned claim = atomic_fetch_add(&vlcLogHead, 1);
+    vlcLogEntry_t *e = &vlcLog[claim % VLCLOG_ENTRIES];
+    atomic_store(&e->seq, 0);
+    e->micros = now;
+    e->level = level;
+    strncpy(e->module, module, VLCLOG_MOD_MAX - 1);
+    e->module[VLCLOG_MOD_MAX - 1] = '\0';
+    vsnprintf(e->text, VLCLOG_TEXT_MAX, fmt, args);
+    atomic_store(&e->seq, claim + 1);
+}
+
+/***
+ * 
+ * vlcLogDump   Print the contents of the VLC log ring, oldest first
+ * 
+ ***/
+void vlcLogDump() {
+    static const char *levelName[] = {"debug", "?", "notice", "warning", "error"};
+    unsigned head = atomic_load(&vlcLogHead);
+    unsigned first = head > VLCLOG_ENTRIES ? head - VLCLOG_ENTRIES : 0;
+    long long now = microsNow();
+    for (unsigned i = first; i < head; i++) {
+        vlcLogEntry_t *e = &vlcLog[i % VLCLOG_ENTRIES];
+        vlcLogEntry_t copy;
+        if (atomic_load(&e->seq) != i + 1) {
+            continue;                                           // Being written or already overwritten
+        }
+        memcpy(&copy, e, sizeof(copy));
+        if (atomic_load(&e->seq) != i + 1) {
+            continue;                                           // Overwritten while we copied it
+        }
+        copy.module[VLCLOG_MOD_MAX - 1] = '\0';
+        copy.text[VLCLOG_TEXT_MAX - 1] = '\0';
+        printf("%8.3f s ago %-7s %-15s %s\n", (now - copy.micros) / 1000000.0, 
+            copy.level >= 0 && copy.level <= LIBVLC_ERROR ? levelName[copy.level] : "?", copy.module, copy.text);
+    }
+    printf("%u VLC log messages kept since startup; %u dropped by the rate limit.\n", 
+        head, atomic_load(&vlcLogDropped));
+}
+
+/***
+ * 
+ * sampleThreads    Fill sample with what /proc says about each of our threads, up to 
+ *                  BENCH_THREADS of them. Returns the number of threads sampled.
+ * 
+ ***/
+int sampleThreads(threadSample_t sample[BENCH_THREADS]) {
+    DIR *dir = opendir("/proc/self/task");
+    if (dir == NULL) {
+        printf("Failed to open /proc/self/task. Error: %s\n", strerror(errno));
+        return 0;
+    }
+    int n = 0;
+    struct dirent *de;
+    while (n < BENCH_THREADS && (de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+        threadSample_t *t = &sample[n];
+        memset(t, 0, sizeof(*t));
+        t->tid = atoi(de->d_name);
+        char path[64], line[256];
+        snprintf(path, sizeof(path), "/proc/self/task/%d/stat", t->tid);
+        FILE *f = fopen(path, "r");
+        if (f == NULL) {
+            continue;                                           // The thread has gone away
+        }
+        if (fgets(line, sizeof(line), f) != NULL) {
+            char *open = strchr(line, '(');                     // The name is in parens and may contain spaces
+            char *close = strrchr(line, ')');
+            if (open != NULL && close != NULL && close > open) {
+                snprintf(t->name, sizeof(t->name), "%.*s", (int)(close - open - 1), open + 1);
+                unsigned long utime, stime;
+                if (sscanf(close + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) == 2) {
+                    t->cpuTicks = utime + stime;
+                }
+            }
+        }
+        fclose(f);
+        snprintf(path, sizeof(path), "/proc/self/task/%d/status", t->tid);
+        f = fopen(path, "r");
+        if (f == NULL) {
+            continue;
+        }
+        while (fgets(line, sizeof(line), f) != NULL) {
+            sscanf(line, "voluntary_ctxt_switches: %lld", &t->wakeups);
+            sscanf(line, "nonvoluntary_ctxt_switches: %lld", &t->preempts);
+        }
+        fclose(f);
+        n++;
+    }
+    closedir(dir);
+    return n;
+}
+
+/***
+ * 
+ * rssKB    Return the resident memory of the process in KB, or 0 if it can't be found
+ * 
+ ***/
+long rssKB() {
+    long pages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%*s %ld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(f);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/***
+ * 
+ * warmClip     Have the kernel start reading rendition r of clip clipId into the page cache (warm 
+ *              true) or let go of it (warm false). Returns the size of the file, or -1 if it can't 
+ *              be opened or, when warming, is bigger than room.
+ * 
+ ***/
+long long warmClip(int clipId, int r, bool warm, long long room) {
+    char path[sizeof(MEDIA_PATH) + CLIP_FILE_MAX] = MEDIA_PATH;
+    strcat(path, clips[clipId].file[r]);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    long long bytes = fstat(fd, &st) == 0 ? st.st_size : -1;
+    if (bytes >= 0 && (!warm || bytes <= room)) {
+        posix_fadvise(fd, 0, 0, warm ? POSIX_FADV_WILLNEED : POSIX_FADV_DONTNEED);
+    } else {
+        bytes = -1;
+    }
+    close(fd);
+    return bytes;
+}
+
+/***
+ * 
+ * preroll      Open rendition r of clip clipId on the idle deck and leave it paused at its first 
+ *              frame, so that starting it later is quick. Only possible with the compositor, and 
+ *              only when the idle deck isn't still part of a crossfade.
+ * 
+ ***/
+void preroll(int clipId, int r) {
+    #if defined(COMPOSITOR) && defined(PREFETCH_PREROLL)
+    int idle = 1 - activeDeck;
+    if (fading || deck[idle].needsStop) {
+        return;
+    }
+    prerollMedia = libvlc_media_duplicate(m[clipId][r]);
+    if (prerollMedia == NULL) {
+        return;
+    }
+    libvlc_media_add_option(prerollMedia, ":start-paused");     // On the copy, so the clip's own item is unaffected
+    libvlc_media_player_set_media(deck[idle].mp, prerollMedia);
+    if (libvlc_media_player_play(deck[idle].mp) != 0) {
+        libvlc_media_release(prerollMedia);
+        prerollMedia = NULL;
+        return;
+    }
+    prerollId = clipId;
+    prerollRendition = r;
+    prerollDeck = idle;
+    traceEvent(trState, "preroll", clipId, r);
+    #endif
+}
+
+/***
+ * 
+ * dropPreroll  Stop the pre-rolled clip, if any, and forget it.
+ * 
+ ***/
+void dropPreroll() {
+    if (prerollId < 0) {
+        return;
+    }
+    #ifdef COMPOSITOR
+    libvlc_media_player_stop(deck[prerollDeck].mp);
+    #endif
+    libvlc_media_release(prerollMedia);
+    prerollMedia = NULL;
+    prerollId = -1;
+}
+
+/***
+ * 
+ * takePreroll  Called as clip clipId starts on mp (after any deck swap). Returns whether mp already 
+ *              has clipId pre-rolled, in which case nowPlayingRendition is set to its rendition. 
+ *              Either way, the pre-roll is used up. Also keeps the prefetch hit statistics. A hint 
+ *              is good for one hit: once a hinted clip starts, the hints are used up too, and the 
+ *              files of the others are let go of, until the controller sends new ones.
+ * 
+ ***/
+bool takePreroll(int clipId) {
+    switchPrefetch = pfNone;
+    if (prefetchCount > 0 && clipId > 0 && clips[clipId].type != loop) {
+        switchPrefetch = pfMiss;
+        for (int i = 0; i < prefetchCount; i++) {
+            if (prefetch[i].clipId == clipId) {
+                switchPrefetch = pfHit;
+            }
+        }
+        if (switchPrefetch == pfHit) {
+            prefetchHits++;
+            for (int i = 0; i < prefetchCount; i++) {
+                if (prefetch[i].clipId != clipId && prefetch[i].bytes > 0) {
+                    warmClip(prefetch[i].clipId, prefetch[i].rendition, false, 0);
+                }
+            }
+            prefetchCount = 0;
+        } else {
+            prefetchMisses++;
+        }
+    }
+    if (prerollId < 0) {
+        return false;
+    }
+    bool hit = prerollId == clipId && prerollDeck == activeDeck;
+    if (hit) {
+        nowPlayingRendition = prerollRendition;
+        nowPlayingCopy = prerollMedia;                          // Its frame counts are the copy's; see noteDroppedFrames()
+        prerollHits++;
+    } else {
+        libvlc_media_release(prerollMedia);                     // The player has its own reference
+    }
+    prerollMedia = NULL;
+    prerollId = -1;
+    return hit;
+}
+
+/***
+ * 
+ * findLanguage Return the index into languages[] of the language whose ISO 639-1 or 639-2 code is 
+ *              code, or -1 if there isn't one. Either of a language's 639-2 codes will do where it 
+ *              has two (e.g., "zho" and "chi"), since tools tag tracks with both.
+ * 
+ ***/
+int findLanguage(const char *code) {
+    for (int lNo = 0; lNo < LANGUAGE_COUNT; lNo++) {
+        if (strcasecmp(code, languages[lNo].code) == 0 || strcasecmp(code, languages[lNo].code3) == 0 || 
+            (languages[lNo].code3b[0] != '\0' && strcasecmp(code, languages[lNo].code3b) == 0)) {
+            return lNo;
+        }
+    }
+    return -1;
+}
+
+/***
+ * 
+ * applyLanguage    If the clip playing has an audio track in language langId that isn't the one 
+ *                  selected, select it. Returns true if it did. VLC switches tracks without 
+ *                  stopping the clip.
+ * 
+ ***/
+bool applyLanguage() {
+    libvlc_media_t *md = libvlc_media_player_get_media(mp);
+    if (md == NULL) {
+        return false;
+    }
+    libvlc_media_track_t **tracks;
+    unsigned n = libvlc_media_tracks_get(md, &tracks);
+    int want = -1;
+    for (unsigned i = 0; i < n && want < 0; i++) {
+        if (tracks[i]->i_type == libvlc_track_audio && tracks[i]->psz_language != NULL && 
+            findLanguage(tracks[i]->psz_language) == langId) {
+            want = tracks[i]->i_id;
+        }
+    }
+    libvlc_media_tracks_release(tracks, n);
+    libvlc_media_release(md);
+    if (want < 0 || libvlc_audio_get_track(mp) == want) {
+        return false;
+    }
+    traceEvent(trState, "lang", langId, want);
+    return libvlc_audio_set_track(mp, want) == 0;
+}
+
+/***
+ * 
+ * overlayInit  Set up how clip player p draws the overlay. Nothing's shown until there's an !overlay.
+ * 
+ ***/
+void overlayInit(libvlc_media_player_t *p) {
+    libvlc_video_set_marquee_int(p, libvlc_marquee_Size, OVERLAY_TEXT_SIZE);
+    libvlc_video_set_marquee_int(p, libvlc_marquee_Position, OVERLAY_TEXT_POS);
+    libvlc_video_set_marquee_int(p, libvlc_marquee_Color, 0xFFFFFF);
+    libvlc_video_set_marquee_int(p, libvlc_marquee_Timeout, 0);  // Stays up until changed
+    libvlc_video_set_logo_int(p, libvlc_logo_position, OVERLAY_BADGE_POS);
+}
+
+/***
+ * 
+ * applyOverlay Have clip player p show text (none if "") and badge (index into badges[]; none if 
+ *              -1) over its video.
+ * 
+ ***/
+void applyOverlay(libvlc_media_player_t *p, const char *text, int badge) {
+    if (text[0] != '\0') {
+        libvlc_video_set_marquee_string(p, libvlc_marquee_Text, text);
+    }
+    libvlc_video_set_marquee_int(p, libvlc_marquee_Enable, text[0] != '\0');
+    if (badge >= 0) {
+        char path[sizeof(MEDIA_PATH) + CLIP_FILE_MAX] = MEDIA_PATH;
+        strcat(path, badges[badge].file);
+        libvlc_video_set_logo_string(p, libvlc_logo_file, path);
+    }
+    libvlc_video_set_logo_int(p, libvlc_logo_enable, badge >= 0);
+}
+
+/***
+ * 
+ * onProfileSignal  SIGPROF handler: record the stack of the thread that was running. Only does 
+ *                  things that are safe in a signal handler; backtrace() is, once it's been 
+ *                  called outside one (see profileRun()).
+ * 
+ ***/
+void onProfileSignal(int sig) {
+    int savedErrno = errno;
+    atomic_fetch_add(&profileInHandler, 1);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+    unsigned n = atomic_fetch_add(&profileHead, 1);
+    if (n < PROFILE_SAMPLES) {
+        profileSample_t *ps = &profileSamples[n];
+        ps->tid = syscall(SYS_gettid);
+        ps->depth = backtrace(ps->pc, PROFILE_DEPTH);
+    }
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+    atomic_fetch_add(&profileHandlerNanos, (t1.tv_sec - t0.tv_sec) * 1000000000LL + (t1.tv_nsec - t0.tv_nsec));
+    atomic_fetch_sub(&profileInHandler, 1);
+    errno = savedErrno;
+}
+
+/***
+ * 
+ * profileFrame     Put a name for code address pc into buf: the function's name if it's exported, 
+ *                  otherwise the name of the file it's in.
+ * 
+ ***/
+void profileFrame(void *pc, char *buf, size_t size) {
+    Dl_info info;
+    if (dladdr(pc, &info) == 0) {
+        snprintf(buf, size, "[unknown]");
+    } else if (info.dli_sname != NULL) {
+        snprintf(buf, size, "%s", info.dli_sname);
+    } else if (info.dli_fname != NULL) {
+        const char *slash = strrchr(info.dli_fname, '/');
+        snprintf(buf, size, "[%s]", slash != NULL ? slash + 1 : info.dli_fname);
+    } else {
+        snprintf(buf, size, "[unknown]");
+    }
+}
+
+int compareLines(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/***
+ * 
+ * profileRun   Sample all threads' stacks for secs seconds and write them to path in folded form: 
+ *              one line per distinct stack, "thread;outermost;...;innermost count". Returns 
+ *              whether it worked. Only one run at a time.
+ * 
+ ***/
+bool profileRun(int secs, const char *path) {
+    if (atomic_flag_test_and_set(&profileBusy)) {
+        puts("A profile is already being taken.");
+        return false;
+    }
+    secs = secs > PROFILE_MAX_SECS ? PROFILE_MAX_SECS : secs;
+    if (profileSamples == NULL) {                   // First run; it's kept for the next one
+        profileSamples = calloc(PROFILE_SAMPLES, sizeof(profileSample_t));
+    }
+    if (profileSamples == NULL) {
+        puts("profile: not enough memory.");
+        atomic_flag_clear(&profileBusy);
+        return false;
+    }
+    void *prime[1];
+    backtrace(prime, 1);                            // Its first call loads libgcc, which isn't signal safe
+    atomic_store(&profileHead, 0);
+    atomic_store(&profileHandlerNanos, 0);
+
+    printf("Profiling for %d seconds at %d samples per CPU second.\n", secs, PROFILE_HZ);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onProfileSignal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, NULL);
+    struct itimerval it = {{0, 1000000 / PROFILE_HZ}, {0, 1000000 / PROFILE_HZ}};
+    setitimer(ITIMER_PROF, &it, NULL);
+    struct timespec until;
+    clock_gettime(CLOCK_MONOTONIC, &until);
+    until.tv_sec += secs;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+    }
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, NULL);
+    signal(SIGPROF, SIG_IGN);                       // In case one's still on its way
+    while (atomic_load(&profileInHandler) > 0) {    // Let any that got in first finish their samples
+        sched_yield();
+    }
+
+    // Fold the samples: make each one a line, sort them and count the duplicates
+    unsigned taken = atomic_load(&profileHead);
+    unsigned kept = taken < PROFILE_SAMPLES ? taken : PROFILE_SAMPLES;
+    char **lines = calloc(kept, sizeof(char *));
+    FILE *f = fopen(path, "w");
+    if (lines == NULL || f == NULL) {
+        printf("Failed to write profile to %s. Error: %s\n", path, strerror(errno));
+        free(lines);
+        if (f != NULL) {
+            fclose(f);
+        }
+        atomic_flag_clear(&profileBusy);
+        return false;
+    }
+    unsigned folded = 0;                            // Number of lines made
+    for (unsigned i = 0; i < kept; i++) {
+        profileSample_t *ps = &profileSamples[i];
+        char line[PROFILE_DEPTH * 48 + 32];
+        char name[48];
+        char commPath[48];
+        snprintf(commPath, sizeof(commPath), "/proc/self/task/%d/comm", ps->tid);
+        FILE *comm = fopen(commPath, "r");
+        if (comm == NULL || fgets(name, sizeof(name), comm) == NULL) {
+            snprintf(name, sizeof(name), "tid %d", ps->tid);   // It's gone
+        }
+        if (comm != NULL) {
+            fclose(comm);
+        }
+        name[strcspn(name, "\n")] = '\0';
+        size_t len = snprintf(line, sizeof(line), "%s", name);
+        for (int d = ps->depth - 1; d >= 2 && len < sizeof(line); d--) {  // Skip the handler and the signal frame
+            profileFrame(ps->pc[d], name, sizeof(name));
+            len += snprintf(line + len, sizeof(line) - len, ";%s", name);
+        }
+        if ((lines[folded] = strdup(line)) != NULL) {
+            folded++;
+        }
+    }
+    qsort(lines, folded, sizeof(char *), compareLines);
+    unsigned stacks = 0;
+    for (unsigned i = 0; i < folded; ) {
+        unsigned j = i + 1;
+        while (j < folded && strcmp(lines[i], lines[j]) == 0) {
+            j++;
+        }
+        fprintf(f, "%s %u\n", lines[i], j - i);
+        stacks++;
+        i = j;
+    }
+    fclose(f);
+    for (unsigned i = 0; i < folded; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+
+    double handlerMs = atomic_load(&profileHandlerNanos) / 1000000.0;
+    printf("Wrote %u samples (%u distinct stacks) to %s.", folded, stacks, path);
+    if (taken > folded) {
+        printf(" %u more didn't fit.", taken - folded);
+    }
+    printf("\nSampling cost %.1f ms of CPU, %.2f%% of the run.\n", handlerMs, handlerMs / (secs * 10.0));
+    atomic_flag_clear(&profileBusy);
+    return true;
+}
+
+/***
+ * 
+ * setTimer     Have main loop generate event type at microsNow() time at; 0 cancels it.
+ *              Only main loop uses the timers.
+ * 
+ ***/
+void setTimer(enum playerEvents type, long long at) {
+    pthread_mutex_lock(&eventLock);
+    timerAt[type] = at;
+    pthread_mutex_unlock(&eventLock);
+}
+
+/***
+ * 
+ * stateForClip     The state main loop is in when playing clip clipId (0 meaning none)
+ * 
+ ***/
+enum playerStates stateForClip(int clipId) {
+    if (clipId == 0) {
+        return stWaiting;
+    }
+    if (clips[clipId].type == fullPlay) {
+        return stLocked;
+    }
+    if (microsNow() < guardUntilMicros) {
+        return stGuarded;
+    }
+    return clips[clipId].type == loop ? stLooping : stPlaying;
+}
+
+/***
+ * 
+ * startClip    Start the media player playing clip clipId
+ * 
+ ***/
+void startClip(int clipId) {
+    noteDroppedFrames(nowPlayingId, nowPlayingRendition);       // Account for how well the last clip played
+    nowPlayingId = clipId;
+    #ifdef COMPOSITOR
+    compSwapDecks();                                            // Start the clip on the other deck and fade to it
+    #endif
+    switchMicros = microsNow();                                 // For seeing what the switch costs
+    switchCount++;
+    switchClipId = clipId;
+    framePending = true;
+    voutPending = true;
+    playPending = true;
+    audioPending = true;
+    if (clipUnderruns > clipUnderrunsMax) {
+        clipUnderrunsMax = clipUnderruns;
+    }
+    clipUnderruns = 0;
+    if (!takePreroll(clipId)) {                                 // Unless it's already paused at its start
+        nowPlayingRendition = chooseRendition(clipId);          //   Decide which rendition of the clip we can manage
+        libvlc_media_player_set_media(mp, m[clipId][nowPlayingRendition]);  // Tell the player to play it
+    } else {
+        applyLanguage();                                        // Its audio tracks showed up while it was idle
+    }
+    traceEvent(trState, "startClip", clipId, nowPlayingRendition);
+    nowPlayingStartMicros = microsNow();
+    guardUntilMicros = 0;
+    if (clips[clipId].type != fullPlay && clips[clipId].guardMs > 0) {
+        guardUntilMicros = nowPlayingStartMicros + clips[clipId].guardMs * 1000LL;
+    }
+    setTimer(evGuardExpired, guardUntilMicros);
+    if (libvlc_media_player_play(mp) != 0) {                    // Try to start playing the clip. If that fails
+        setFullscreen(false);                                   //   Get out of fullscreen mode
+        puts("Failed to start clip. Stopping");                 //   Bail out
+        running = false;
+    }
+}
+
+/***
+ * 
+ * finishClip   Wrap up the clip that's been playing: if it was a requested clip, tell the 
+ *              controller it's done.
+ * 
+ ***/
+void finishClip() {
+    if (nowPlayingId != 0 && clips[nowPlayingId].type != loop) {
+        printf("Finished clip %d (%s)\n", nowPlayingId, clips[nowPlayingId].name);
+        traceEvent(trState, "finishClip", nowPlayingId, 0);
+        if (ctlOut == NULL) {                                   // Controller link isn't up yet
+            return;
+        }
+        fprintf(ctlOut, "!videoEnds\n");                       // Let the controller know the clip finished
+        linkSentMicros = microsNow();                           // Time how long it takes to respond
+        if (ferror(ctlOut)) {
+            printf("!videoEnds fprintf error: %s\n", strerror(errno));
+        }
+    }
+}
+
+/***
+ * 
+ * startNext    Start whatever should play next: the oldest pending clip if there is one, 
+ *              otherwise the looping clip. If there's no looping clip, stop the player.
+ * 
+ ***/
+void startNext() {
+    if (pendingCount > 0) {
+        int clipId = pending[0];
+        pendingCount--;
+        memmove(&pending[0], &pending[1], pendingCount * sizeof(pending[0]));
+        printf("Starting clip %d (%s)\n", clipId, clips[clipId].name);
+        startClip(clipId);
+    } else if (reqLoopId != 0) {
+        startClip(reqLoopId);
+    } else {
+        noteDroppedFrames(nowPlayingId, nowPlayingRendition);
+        nowPlayingId = 0;
+        libvlc_media_player_stop(mp);
+    }
+}
+
+/***
+ * 
+ * endScrub     Wrap up a scrub: report on how it went and cancel its timers
+ * 
+ ***/
+void endScrub() {
+    printf("Done scrubbing clip %d (%s). %d seeks; request to position change avg %lld us, max %lld us\n", 
+        nowPlayingId, clips[nowPlayingId].name, seekCount, 
+        seekCount == 0 ? 0 : seekTotalMicros / seekCount, seekMaxMicros);
+    traceEvent(trState, "endScrub", nowPlayingId, seekCount);
+    setTimer(evSeekDue, 0);
+    setTimer(evScrubIdle, 0);
+    scrubHasTarget = false;
+    scrubNeedsHold = false;
+}
+
+/***
+ * 
+ * validClip    Whether clipId is a clip that can be requested. If not, say so. Clip 0, noClip, 
+ *              is a request to stop playing a clip and go back to the looping clip.
+ * 
+ ***/
+bool validClip(int clipId) {
+    if (clipId < 0 || clipId >= CLIP_COUNT) {
+        printf("Controller asked for non-existent clip: %d. Ignoring request.\n", clipId);
+        return false;
+    }
+    return true;
+}
+
+/***
+ * 
+ * Main loop's actions. Each is called with the event that triggered it and returns true if the 
+ * transition is to be made -- main loop moves to the state given in transitions[] -- or false if 
+ * the event turned out to be one to ignore.
+ * 
+ ***/
+
+// Start the requested clip now, interrupting whatever's playing
+bool actStartClip(playerEvent_t *e) {
+    if (!validClip(e->arg)) {
+        return false;
+    }
+    printf("Switching to clip %d (%s)\n", e->arg, clips[e->arg].name);
+    if (playerState == stScrubbing) {
+        endScrub();
+    }
+    finishClip();
+    pendingCount = 0;
+    if (e->arg == 0) {
+        startNext();
+    } else {
+        printf("Starting clip %d (%s)\n", e->arg, clips[e->arg].name);
+        startClip(e->arg);
+    }
+    return true;
+}
+
+// Hold the requested clip until the one playing can be interrupted, per the playing clip's policy
+bool actPendClip(playerEvent_t *e) {
+    if (!validClip(e->arg)) {
+        return false;
+    }
+    if (clips[nowPlayingId].pending == replacePending || e->arg == 0) {
+        pendingCount = 0;
+    }
+    if (e->arg == 0) {
+        return true;                                            // Nothing's waiting now
+    }
+    if (pendingCount == PENDING_MAX) {
+        printf("Too many clips waiting; ignoring request for clip %d (%s)\n", e->arg, clips[e->arg].name);
+        return false;
+    }
+    pending[pendingCount++] = e->arg;
+    printf("Clip %d (%s) waiting for clip %d (%s) to finish\n", e->arg, clips[e->arg].name, nowPlayingId, clips[nowPlayingId].name);
+    return true;
+}
+
+// Make the requested clip the looping clip, for use when nothing else is playing
+bool actSetLoop(playerEvent_t *e) {
+    if (!validClip(e->arg)) {
+        return false;
+    }
+    if (clips[e->arg].type != loop) {
+        printf("Ignoring request to loop non-looping clip %s\n", clips[e->arg].name);
+        return false;
+    }
+    printf("Switching looping clip to %d (%s)\n", e->arg, clips[e->arg].name);
+    traceEvent(trState, "switchLoop", e->arg, reqLoopId);
+    reqLoopId = e->arg;
+    return true;
+}
+
+// Make the requested clip the looping clip and start playing it in place of the one playing
+bool actSwitchLoop(playerEvent_t *e) {
+    if (!actSetLoop(e)) {
+        return false;
+    }
+    startClip(reqLoopId);
+    return true;
+}
+
+// The clip playing has ended; move on to what's next
+bool actNext(playerEvent_t *e) {
+    if (e->micros < nowPlayingStartMicros) {
+        return false;                                           // The end of a clip we've since replaced
+    }
+    if (e->arg != 0) {
+        printf("Media player failed playing clip %d (%s).\n", nowPlayingId, clips[nowPlayingId].name);
+    }
+    finishClip();
+    startNext();
+    return true;
+}
+
+// The clip playing can now be interrupted; if something's waiting, start it
+bool actGuardDone(playerEvent_t *e) {
+    if (pendingCount > 0) {
+        finishClip();
+        startNext();
+    }
+    return true;
+}
+
+// Issue a seek to the latest scrub position if the screen can show another one by now; 
+// otherwise set a timer for when it can
+bool actSeek(playerEvent_t *e) {
+    if (!scrubHasTarget || scrubNeedsHold) {
+        return true;
+    }
+    long long now = microsNow();
+    long long nextFrame = seekIssuedMicros + 1000000 / FRAME_RATE;
+    long long giveUp = seekIssuedMicros + SCRUB_SEEK_MS * 1000LL;
+    if ((!seekInFlight && now >= nextFrame) || now >= giveUp) {
+        seekFrom = lastPosition;
+        seekInFlight = true;
+        traceEvent(trState, "seek", nowPlayingId, (int)(scrubTarget * 1000));
+        seekIssuedMicros = now;
+        seekRequestMicros = scrubTargetMicros;
+        scrubHasTarget = false;
+        libvlc_media_player_set_position(mp, scrubTarget);
+    } else {
+        setTimer(evSeekDue, seekInFlight ? giveUp : nextFrame);
+    }
+    return true;
+}
+
+// Take the latest scrub position but don't act on it: the clip playing can't be interrupted. The 
+// dial keeps sending positions, so scrubbing starts with the first one after the clip allows it.
+bool actScrubDrop(playerEvent_t *e) {
+    piLock(LOCK_SCRUB);                                         // Do the ritual so the next position gets posted
+    int scrubId = scrubClipId;
+    scrubPending = false;
+    piUnlock(LOCK_SCRUB);
+    traceEvent(trState, "scrub dropped", scrubId, nowPlayingId);
+    #ifdef DEBUG
+    printf("Clip %d (%s) can't be interrupted. Dropping scrub of clip %d.\n", 
+        nowPlayingId, clips[nowPlayingId].name, scrubId);
+    #endif
+    return false;
+}
+
+// Take the latest scrub position. If it's for a clip we aren't scrubbing, set that clip up.
+bool actScrub(playerEvent_t *e) {
+    piLock(LOCK_SCRUB);                                         // Do the ritual to get the position
+    int scrubId = scrubClipId;
+    scrubTarget = scrubPermille / 1000.0;
+    if (scrubTarget > SCRUB_LAST_POS) {                         // Not the very end, which would end the clip
+        scrubTarget = SCRUB_LAST_POS;
+    }
+    scrubTargetMicros = scrubRequestMicros;
+    scrubPending = false;
+    piUnlock(LOCK_SCRUB);
+    scrubHasTarget = true;
+    setTimer(evScrubIdle, scrubTargetMicros + SCRUB_IDLE_MS * 1000LL);
+    if (playerState != stScrubbing || scrubId != nowPlayingId) {
+        if (playerState == stScrubbing) {
+            endScrub();
+            scrubHasTarget = true;
+            setTimer(evScrubIdle, scrubTargetMicros + SCRUB_IDLE_MS * 1000LL);
+        } else {
+            finishClip();                                       // The clip it interrupts is over
+        }
+        noteDroppedFrames(nowPlayingId, nowPlayingRendition);
+        nowPlayingId = scrubId;
+        #ifdef COMPOSITOR
+        compSwapDecks();
+        #endif
+        takePreroll(-1);                                        // Any pre-rolled clip is about to be replaced
+        if (mProxy[scrubId] != NULL) {                          // Use the keyframe-only proxy if there is one
+            nowPlayingRendition = -1;
+            libvlc_media_player_set_media(mp, mProxy[scrubId]);
+        } else {
+            nowPlayingRendition = chooseRendition(scrubId);
+            libvlc_media_player_set_media(mp, m[scrubId][nowPlayingRendition]);
+        }
+        printf("Scrubbing clip %d (%s)%s\n", scrubId, clips[scrubId].name, 
+            nowPlayingRendition < 0 ? " using its proxy" : "");
+        traceEvent(trState, "startScrub", scrubId, nowPlayingRendition);
+        nowPlayingStartMicros = microsNow();
+        guardUntilMicros = 0;
+        setTimer(evGuardExpired, 0);
+        pendingCount = 0;
+        seekInFlight = false;
+        seekIssuedMicros = 0;
+        lastPosition = 0.0;
+        seekCount = 0;
+        seekTotalMicros = 0;
+        seekMaxMicros = 0;
+        scrubNeedsHold = true;                                  // Get it going; hold it still once it is
+        if (libvlc_media_player_play(mp) != 0) {
+            puts("Failed to start clip for scrubbing.");
+        }
+        return true;
+    }
+    return actSeek(e);
+}
+
+// The scrubbed clip has started playing; hold it still and seek to where the dial is
+bool actScrubHold(playerEvent_t *e) {
+    if (scrubNeedsHold) {
+        scrubNeedsHold = false;
+        libvlc_media_player_set_pause(mp, 1);
+    }
+    return actSeek(e);
+}
+
+// A seek took the scrubbed clip to its end; start it again, hold it and seek back to the dial
+bool actScrubRestart(playerEvent_t *e) {
+    if (e->micros < nowPlayingStartMicros) {
+        return false;                                           // The end of a clip we've since replaced
+    }
+    if (e->arg != 0) {                                          // Don't keep restarting one that fails
+        printf("Media player failed scrubbing clip %d (%s).\n", nowPlayingId, clips[nowPlayingId].name);
+        return false;
+    }
+    traceEvent(trState, "scrub restart", nowPlayingId, (int)(scrubTarget * 1000));
+    scrubHasTarget = true;                                      // scrubTarget is still the last position sought
+    scrubNeedsHold = true;
+    seekInFlight = false;
+    lastPosition = 0.0;
+    if (libvlc_media_player_play(mp) != 0) {
+        puts("Failed to restart clip for scrubbing.");
+    }
+    return true;
+}
+
+// The dial's gone idle; carry on as if the scrubbed clip had finished
+bool actScrubIdle(playerEvent_t *e) {
+    endScrub();
+    finishClip();
+    startNext();
+    return true;
+}
+
+// Take the latest prefetch hints: let go of what was prefetched for clips no longer hinted, then 
+// read ahead and parse the new ones, within the budget, and pre-roll the first
+bool actPrefetch(playerEvent_t *e) {
+    int ids[PREFETCH_MAX];
+    piLock(LOCK_PREFETCH);
+    int count = hintCount;
+    memcpy(ids, hintIds, sizeof(ids));
+    hintPending = false;
+    piUnlock(LOCK_PREFETCH);
+
+    for (int i = 0; i < prefetchCount; i++) {
+        bool kept = prefetch[i].clipId == nowPlayingId;
+        for (int j = 0; j < count; j++) {
+            kept = kept || ids[j] == prefetch[i].clipId;
+        }
+        if (!kept && prefetch[i].bytes > 0) {
+            warmClip(prefetch[i].clipId, prefetch[i].rendition, false, 0);
+        }
+    }
+    if (prerollId >= 0 && (count == 0 || prerollId != ids[0])) {
+        dropPreroll();
+    }
+
+    long long room = PREFETCH_BUDGET_MB * 1024LL * 1024LL;
+    prefetchCount = 0;
+    for (int j = 0; j < count; j++) {
+        int id = ids[j];
+        int r = pickRendition(id, false);                       // What it would be started in now
+        long long bytes = warmClip(id, r, true, room);
+        if (bytes < 0) {
+            printf("Not reading ahead clip %d (%s): missing or over the %d MB budget.\n", id, clips[id].name, PREFETCH_BUDGET_MB);
+            bytes = 0;
+        }
+        room -= bytes;
+        if (libvlc_media_get_parsed_status(m[id][r]) != libvlc_media_parsed_status_done) {
+            libvlc_media_parse_with_options(m[id][r], libvlc_media_parse_local, PREFETCH_PARSE_MS);
+        }
+        prefetch[prefetchCount++] = (prefetch_t){id, r, bytes};
+    }
+    if (prefetchCount > 0 && prerollId < 0) {
+        preroll(prefetch[0].clipId, prefetch[0].rendition);
+    }
+    traceEvent(trState, "prefetch", count, prerollId);
+    return true;
+}
+
+// Switch languages, including the audio track of the clip playing if it has one in the new language
+bool actLang(playerEvent_t *e) {
+    langId = e->arg;
+    printf("Language set to %s\n", languages[langId].code);
+    langPending = false;
+    if (applyLanguage()) {
+        langRequestMicros = e->micros;
+        langPending = true;
+    }
+    return true;
+}
+
+// The clip playing has a new audio track; if it's in our language, use it
+bool actAudioTrack(playerEvent_t *e) {
+    applyLanguage();
+    return true;
+}
+
+// Show the latest overlay on the clip player(s)
+bool actOverlay(playerEvent_t *e) {
+    char text[OVERLAY_TEXT_MAX];
+    piLock(LOCK_OVERLAY);
+    strcpy(text, overlayText);
+    int badge = overlayBadge;
+    long long requested = overlayRequestMicros;
+    overlayPending = false;
+    piUnlock(LOCK_OVERLAY);
+
+    #ifdef COMPOSITOR
+    applyOverlay(deck[0].mp, text, badge);                      // Both, so it's up whichever deck is next
+    applyOverlay(deck[1].mp, text, badge);
+    #else
+    applyOverlay(mp, text, badge);
+    #endif
+    traceEvent(trState, "overlay", badge, text[0] != '\0');
+    overlayAppliedMicros = microsNow();
+    long long took = overlayAppliedMicros - requested;
+    overlayApplyTotalMicros += took;
+    if (took > overlayApplyMaxMicros) {
+        overlayApplyMaxMicros = took;
+    }
+    overlayUpdates++;
+    #ifdef COMPOSITOR
+    overlayShownFrom = requested;
+    #endif
+    return true;
+}
+
+// The crossfade is done; stop the old deck
+bool actReap(playerEvent_t *e) {
+    #ifdef COMPOSITOR
+    compReap();
+    #endif
+    return true;
+}
+
+// The escape hatch timer went off
+bool actEscape(playerEvent_t *e) {
+    puts("Stopping: Escape hatch activated.");
+    running = false;
+    return true;
+}
+
+// The state transition table: what main loop does about each event in each state, and the state 
+// it moves to. Events not listed for a state are ignored in that state.
+typedef struct transition_t {
+    bool (*action)(playerEvent_t *e);               // What to do
+    enum playerStates next;                         // The state to move to if action returns true
+} transition_t;
+
+#define ANY_STATE \
+    [evPrefetch]        = {actPrefetch, stSame}, \
+    [evLang]            = {actLang, stSame}, \
+    [evAudioTrack]      = {actAudioTrack, stSame}, \
+    [evOverlay]         = {actOverlay, stSame}, \
+    [evFadeDone]        = {actReap, stSame}, \
+    [evEscape]          = {actEscape, stSame}
+
+transition_t transitions[STATE_COUNT][EVENT_COUNT] = {
+    [stWaiting] = {
+        [evPlayClip]        = {actStartClip, stFromClip},
+        [evPriorityClip]    = {actStartClip, stFromClip},
+        [evSetLoop]         = {actSwitchLoop, stFromClip},
+        [evScrub]           = {actScrub, stScrubbing},
+        ANY_STATE
+    },
+    [stLooping] = {
+        [evPlayClip]        = {actStartClip, stFromClip},
+        [evPriorityClip]    = {actStartClip, stFromClip},
+        [evSetLoop]         = {actSwitchLoop, stFromClip},
+        [evClipEnd]         = {actNext, stFromClip},
+        [evGuardExpired]    = {actGuardDone, stFromClip},
+        [evScrub]           = {actScrub, stScrubbing},
+        ANY_STATE
+    },
+    [stPlaying] = {
+        [evPlayClip]        = {actStartClip, stFromClip},
+        [evPriorityClip]    = {actStartClip, stFromClip},
+        [evSetLoop]         = {actSetLoop, stSame},
+        [evClipEnd]         = {actNext, stFromClip},
+        [evScrub]           = {actScrub, stScrubbing},
+        ANY_STATE
+    },
+    [stGuarded] = {
+        [evPlayClip]        = {actPendClip, stSame},
+        [evPriorityClip]    = {actStartClip, stFromClip},
+        [evSetLoop]         = {actSetLoop, stSame},
+        [evClipEnd]         = {actNext, stFromClip},
+        [evGuardExpired]    = {actGuardDone, stFromClip},
+        [evScrub]           = {actScrubDrop, stSame},
+        ANY_STATE
+    },
+    [stLocked] = {
+        [evPlayClip]        = {actPendClip, stSame},
+        [evPriorityClip]    = {actStartClip, stFromClip},
+        [evSetLoop]         = {actSetLoop, stSame},
+        [evClipEnd]         = {actNext, stFromClip},
+        [evScrub]           = {actScrubDrop, stSame},
+        ANY_STATE
+    },
+    [stScrubbing] = {
+        [evPlayClip]        = {actStartClip, stFromClip},
+        [evPriorityClip]    = {actStartClip, stFromClip},
+        [evSetLoop]         = {actSetLoop, stSame},
+        [evPlaying]         = {actScrubHold, stSame},
+        [evClipEnd]         = {actScrubRestart, stSame},
+        [evScrub]           = {actScrub, stScrubbing},
+        [evSeekDone]        = {actSeek, stSame},
+        [evSeekDue]         = {actSeek, stSame},
+        [evScrubIdle]       = {actScrubIdle, stFromClip},
+        ANY_STATE
+    }
+};
+
+/***
+ * 
+ * dispatch     Do what transitions[] says to about event e and move to the resulting state
+ * 
+ ***/
+void dispatch(playerEvent_t *e) {
+    static const char *stateName[STATE_COUNT] = {"waiting", "looping", "playing", "guarded", "locked", "scrubbing"};
+    if (e->type == evPlayClip && e->arg > 0 && e->arg < CLIP_COUNT && nowPlayingId != 0 && 
+        clips[e->arg].priority > clips[nowPlayingId].priority) {
+        e->type = evPriorityClip;                               // It outranks what's playing
+    }
+    transition_t *t = &transitions[playerState][e->type];
+    if (t->action == NULL || !t->action(e)) {
+        return;
+    }
+    enum playerStates was = playerState;
+    if (t->next == stFromClip) {
+        playerState = stateForClip(nowPlayingId);
+    } else if (t->next != stSame) {
+        playerState = t->next;
+    }
+    if (playerState != was) {
+        traceEvent(trState, stateName[playerState], e->type, was);
+        #ifdef DEBUG
+        printf("State %s -> %s on event %d\n", stateName[was], stateName[playerState], e->type);
+        #endif
+    }
+    playerMode = playerState == stWaiting ? waitingMode : playerState == stLooping ? loopingMode : playingMode;
+}
+
+/***
+ * 
+ * showStartup  Print how long each startup phase took, relative to the start of main
+ * 
+ ***/
+void showStartup() {
+    static const char *phaseName[PHASE_COUNT] = {
+        "signal thread", "keyboard thread", "history file", "controller thread", "controller link", 
+        "libVLC engine", "media items", "media player", "video surface", "audio output", "sound effects"
+    };
+    printf("%-18s %9s %9s\n", "phase", "start ms", "took ms");
+    for (int ph = 0; ph < PHASE_COUNT; ph++) {
+        if (phaseTime[ph].begin == 0) {
+            printf("%-18s %9s\n", phaseName[ph], "-");
+        } else if (phaseTime[ph].end == 0) {
+            printf("%-18s %9.1f %9s\n", phaseName[ph], (phaseTime[ph].begin - mainMicros) / 1000.0, "running");
+        } else {
+            printf("%-18s %9.1f %9.1f\n", phaseName[ph], (phaseTime[ph].begin - mainMicros) / 1000.0, 
+                (phaseTime[ph].end - phaseTime[ph].begin) / 1000.0);
+        }
+    }
+    if (firstFrameMicros != 0) {
+        double live = (firstFrameMicros - mainMicros) / 1000000.0;
+        printf("Video playing %.2f s after main started, %.2f s after boot.\n", live, uptimeAtMain + live);
+    } else {
+        puts("No video playing yet.");
+    }
+}
+
+/***
+ * 
+ * Command handler for help command
+ * 
+ ***/
+void onHelp(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    puts(
+        "help           Type this help text.\n"
+        "h              Same as help\n"
+    );
+    puts(
+        "audio          Show how long clips' sound took to start and how many dropouts there were\n"
+        "history [hours|days|compare|clips [<n>]]\n"
+        "               Show the latency history by hour or day, compared with earlier or by clip\n"
+        "lang           Show the current clip's audio tracks and how long language switches took\n"
+        "lang <code>    Play clips' audio in the language with ISO 639 code <code>, like !lang\n"
+        "overlay        Show what's overlaid on the video and how long updates took\n"
+        "overlay text <words> | badge <bName> | clear\n"
+        "               Set what's overlaid on the video, like !overlay\n"
+        "play <cName>   Play clip with name <cName>\n"
+        "powerbench [<secs>]  Measure wakeups, CPU and memory for <secs> (default 30) seconds\n"
+        "profile [<secs> [<file>]]  Sample all threads' stacks for <secs> (default 10) seconds;\n"
+        "               write them to <file> (default " PROFILE_PATH ") as folded stacks\n"
+        "prefetch       Show the prefetch hints and how well they've worked out\n"
+        "prefetch <cId> ...  Get ready to play clips with ids <cId> ..., like !prefetch\n"
+        "renditions     Show the dropped-frame rate of each rendition\n"
+        "scrub <cId> <pm>  Show clip with id <cId> paused <pm>/1000 of the way through\n"
+        "sfx <sName>    Play sound effect with name <sName> over the current clip\n"
+        "vlclog         Show the recent VLC log messages\n"
+        "vlclog <module> debug|notice|warning|error|off\n"
+        "               Set minimum level of VLC log messages kept from <module> (\"*\" for all others)\n"
+        "startup        Show how long each phase of startup took\n"
+        "surface        Show how many clip switches needed a new video output\n"
+        "stop           Shutdown the media player\n"
+        "trace [<file>] Write the trace to <file> (default " TRACE_PATH ") in Chrome trace format\n"
+    );
+}
+
+/***
+ * 
+ * Command handler for play command
+ * 
+ * play cName   Play clip cName; where cName is one of
+ *              the clips[].name entries
+ ***/
+void onPlay(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    if (n < 2) {
+        puts("Clip name not specified.\n");
+        return;
+    }
+    for (int cNo = 0; cNo < CLIP_COUNT; cNo++) {
+        if (strcmp(word[1], clips[cNo].name) == 0) {
+            postEvent(evPlayClip, cNo);
+            return;
+        }
+    }
+    printf("No clip named \"%s\"\n", word[1]);
+}
+
+/***
+ * 
+ * Command handler for the !playClip command, issued by controller
+ * 
+ * !playClip clipId
+ *      Play the clip whose clip id -- the index into 
+ *      clips[] -- is clipId
+ ***/
+void onPlayClip(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    int clipId = 0;
+    if (n < 2) {
+        puts("!playClip inviked with no clipId specified; used 0.\n");
+    } else {
+        clipId = atoi(word[1]);
+        if (clipId < 0 || clipId >= CLIP_COUNT) {
+            printf("!playClip inviked with invalid clipId: \"%s\"; used .", word[1]);
+            clipId = 0;
+        }
+    }
+    postEvent(evPlayClip, clipId);
+}
+
+/***
+ * 
+ * Command handler for !setLoop command, issued by controller
+ * 
+ * !setLoop clipId
+ *      Set the video loop to be played when we're not playing something else
+ *      to the clip whose id -- the index into clips[] -- is clipId. 
+ *      If a loop is already playing, switch to playing this loop instead.
+ ***/
+void onSetLoop(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    int clipId = 0;
+    if (n < 2) {
+        puts("!setLoop invoked with no clipId specified; used 0.\n");
+    } else {
+        clipId = atoi(word[1]);
+        if (clipId < 0 || clipId >= CLIP_COUNT) {
+            printf("!setLoop invoked with invalid clipId: \"%s\"; used 0.", word[1]);
+            clipId = 0;
+        }
+    }
+    postEvent(evSetLoop, clipId);
+}
+
+/***
+ * 
+ * Command handler for sfx and !sfx commands
+ * 
+ * sfx sName    Play the sound effect sName over whatever is playing; 
+ *              sName is one of the sfx[].name entries
+ * !sfx sName   Same as sfx, but issued from controller
+ * 
+ ***/
+void onSfx(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    if (n < 2) {
+        printf("%s invoked with no sound effect name specified.\n", word[0]);
+        return;
+    }
+    for (int sNo = 0; sNo < SFX_COUNT; sNo++) {
+        if (strcmp(word[1], sfx[sNo].name) == 0) {
+            if (sfxPlayer[sNo].samples == NULL) {
+                printf("Sound effect \"%s\" isn't loaded.\n", word[1]);
+                return;
+            }
+            traceEvent(trState, "sfx", sNo, 0);
+            pthread_mutex_lock(&sfxLock);
+            sfxPlayer[sNo].triggerMicros = microsNow();
+            atomic_store(&sfxPlayer[sNo].restart, true);
+            pthread_cond_broadcast(&sfxTriggered);             // Its thread does the writing
+            pthread_mutex_unlock(&sfxLock);
+            return;
+        }
+    }
+    printf("No sound effect named \"%s\"\n", word[1]);
+}
+
+#ifdef COMPOSITOR
+/***
+ * 
+ * Command handler for crossfade and !crossfade commands
+ * 
+ * crossfade ms     Set the length of the crossfade between clips to ms milliseconds;
+ *                  0 means hard cuts
+ * !crossfade ms    Same as crossfade, but issued from controller
+ * 
+ ***/
+void onCrossfade(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    if (n < 2 || atoi(word[1]) < 0) {
+        printf("%s needs a crossfade length in ms; it's %d ms.\n", word[0], crossfadeMs);
+        return;
+    }
+    crossfadeMs = atoi(word[1]);
+    printf("Crossfade set to %d ms.\n", crossfadeMs);
+}
+#endif
+
+/***
+ * 
+ * Command handler for blendbench command
+ * 
+ * blendbench   Time BENCH_FRAMES full-screen crossfade blends, with blendRow() and with 
+ *              blendRowScalar(), and compare them to the time available per frame
+ * 
+ ***/
+void onBlendBench(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    size_t bytes = (size_t)fbWidth * fbHeight * 4;
+    uint8_t *a = malloc(bytes), *b = malloc(bytes), *dst = malloc(bytes);
+    if (a == NULL || b == NULL || dst == NULL) {
+        puts("blendbench: not enough memory.");
+        free(a); free(b); free(dst);
+        return;
+    }
+    for (size_t i = 0; i < bytes; i++) {
+        a[i] = i;
+        b[i] = ~i;
+    }
+    void (*kernel[2])(uint8_t *, const uint8_t *, const uint8_t *, size_t, unsigned) = {blendRow, blendRowScalar};
+    const char *kernelName[2] = {"blendRow", "blendRowScalar"};
+    double budgetMs = 1000.0 / FRAME_RATE;
+    for (int k = 0; k < 2; k++) {
+        long long start = microsNow();
+        for (int f = 0; f < BENCH_FRAMES; f++) {
+            unsigned alpha = f * 256 / BENCH_FRAMES;
+            for (unsigned y = 0; y < fbHeight; y++) {
+                kernel[k](dst + y * fbWidth * 4, a + y * fbWidth * 4, b + y * fbWidth * 4, fbWidth * 4, alpha);
+            }
+        }
+        double perFrameMs = (microsNow() - start) / 1000.0 / BENCH_FRAMES;
+        printf("%-15s %ux%u: %.2f ms per frame, %.0f%% of the %.1f ms frame budget.\n", 
+            kernelName[k], fbWidth, fbHeight, perFrameMs, 100.0 * perFrameMs / budgetMs, budgetMs);
+    }
+    free(a);
+    free(b);
+    free(dst);
+}
+
+/***
+ * 
+ * Command handler for scrub and !scrub commands
+ * 
+ * !scrub clipId permille
+ *      Show the clip whose id is clipId, paused at position permille / 1000 of the 
+ *      way through. Issued by the controller as the visitor turns a dial.
+ * scrub clipId permille
+ *      Same as !scrub, but from the keyboard
+ * 
+ ***/
+void onScrub(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    if (n < 3) {
+        printf("%s needs a clipId and a position in permille.\n", word[0]);
+        return;
+    }
+    int clipId = atoi(word[1]);
+    int permille = atoi(word[2]);
+    if (clipId <= 0 || clipId >= CLIP_COUNT) {
+        printf("%s invoked with invalid clipId: \"%s\"; ignored.\n", word[0], word[1]);
+        return;
+    }
+    permille = permille < 0 ? 0 : permille > 1000 ? 1000 : permille;
+    piLock(LOCK_SCRUB);     // Get the lock
+    scrubClipId = clipId;
+    scrubPermille = permille;
+    scrubRequestMicros = microsNow();
+    if (!scrubPending) {    // If main loop hasn't yet been told about an earlier one, tell it
+        scrubPending = true;
+        postEvent(evScrub, 0);
+    }
+    piUnlock(LOCK_SCRUB);   // Release the lock
+}
+
+/***
+ * 
+ * Command handler for !lang command, issued by controller
+ * 
+ * !lang <code> Play the audio of this and later clips in the language whose ISO 639 code is 
+ *              <code>, for clips that have it
+ * 
+ ***/
+void onLang(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    if (n < 2) {
+        printf("%s needs a language code.\n", word[0]);
+        return;
+    }
+    int lNo = findLanguage(word[1]);
+    if (lNo < 0) {
+        printf("%s invoked with unknown language: \"%s\"; ignored.\n", word[0], word[1]);
+        return;
+    }
+    postEvent(evLang, lNo);
+}
+
+/***
+ * 
+ * Command handler for lang command
+ * 
+ * lang         Show the audio tracks of the clip playing and how long language switches took
+ * lang <code>  Same as the controller's !lang
+ * 
+ ***/
+void onLangKb(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    if (n > 1) {
+        onLang(n, word);
+        return;
+    }
+    printf("Language is %s.\n", languages[langId].code);
+    libvlc_media_t *md = mp == NULL ? NULL : libvlc_media_player_get_media(mp);
+    if (md != NULL) {
+        libvlc_media_track_t **tracks;
+        unsigned count = libvlc_media_tracks_get(md, &tracks);
+        int selected = libvlc_audio_get_track(mp);
+        for (unsigned i = 0; i < count; i++) {
+            if (tracks[i]->i_type == libvlc_track_audio) {
+                printf("%c track %d: %s\n", tracks[i]->i_id == selected ? '*' : ' ', tracks[i]->i_id, 
+                    tracks[i]->psz_language != NULL ? tracks[i]->psz_language : "(no language)");
+            }
+        }
+        libvlc_media_tracks_release(tracks, count);
+        libvlc_media_release(md);
+    }
+    if (langSwitches > 0) {
+        printf("%lu switches took %.1f ms on average, %.1f ms at most.\n", 
+            langSwitches, langTotalMicros / 1000.0 / langSwitches, langMaxMicros / 1000.0);
+    }
+}
+
+/***
+ * 
+ * Command handler for !overlay command, issued by controller
+ * 
+ * !overlay text <words> ...
+ *      Show <words> over the video, replacing any text already shown
+ * !overlay badge <bName>
+ *      Show the badge named <bName> over the video, replacing any badge already shown
+ * !overlay clear
+ *      Take the text and badge down
+ * 
+ ***/
+void onOverlay(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    int badge = -1;
+    if (n >= 3 && strcmp(word[1], "badge") == 0) {
+        for (int bNo = 0; bNo < BADGE_COUNT; bNo++) {
+            if (strcmp(word[2], badges[bNo].name) == 0) {
+                badge = bNo;
+            }
+        }
+        if (badge < 0) {
+            printf("No badge named \"%s\"\n", word[2]);
+            return;
+        }
+    } else if (!(n >= 2 && (strcmp(word[1], "text") == 0 || strcmp(word[1], "clear") == 0))) {
+        printf("%s needs \"text <words>\", \"badge <bName>\" or \"clear\".\n", word[0]);
+        return;
+    }
+    piLock(LOCK_OVERLAY);   // Get the lock
+    if (strcmp(word[1], "badge") == 0) {
+        overlayBadge = badge;
+    } else if (strcmp(word[1], "text") == 0) {
+        overlayText[0] = '\0';
+        for (int i = 2; i < n; i++) {
+            if (strlen(overlayText) + strlen(word[i]) + 2 > OVERLAY_TEXT_MAX) {
+                break;
+            }
+            if (i > 2) {
+                strcat(overlayText, " ");
+            }
+            strcat(overlayText, word[i]);
+        }
+    } else {
+        overlayText[0] = '\0';
+        overlayBadge = -1;
+    }
+    overlayRequestMicros = microsNow();
+    if (!overlayPending) {  // If main loop hasn't yet been told about an earlier one, tell it
+        overlayPending = true;
+        postEvent(evOverlay, 0);
+    }
+    piUnlock(LOCK_OVERLAY); // Release the lock
+}
+
+/***
+ * 
+ * Command handler for overlay command
+ * 
+ * overlay      Show what's overlaid on the video and how long overlay updates took
+ * overlay ...  Same as the controller's !overlay
+ * 
+ ***/
+void onOverlayKb(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    if (n > 1) {
+        onOverlay(n, word);
+        return;
+    }
+    piLock(LOCK_OVERLAY);
+    printf("Overlay text: \"%s\", badge: %s\n", overlayText, overlayBadge < 0 ? "none" : badges[overlayBadge].name);
+    piUnlock(LOCK_OVERLAY);
+    if (overlayUpdates > 0) {
+        printf("%lu updates applied %.2f ms after the command on average, %.2f ms at most.\n", 
+            overlayUpdates, overlayApplyTotalMicros / 1000.0 / overlayUpdates, overlayApplyMaxMicros / 1000.0);
+    }
+    if (overlayShown > 0) {
+        printf("%lu updates on screen %.1f ms after the command on average, %.1f ms at most.\n", 
+            overlayShown, overlayShownTotalMicros / 1000.0 / overlayShown, overlayShownMaxMicros / 1000.0);
+    }
+}
+
+/***
+ * 
+ * Command handler for !prefetch command, issued by controller
+ * 
+ * !prefetch [<clipId> ...]
+ *      Get ready to play any of the clips whose clip ids are given, in order of likelihood. 
+ *      Replaces any earlier hints; with no clipIds, just cancels them.
+ * 
+ ***/
+void onPrefetch(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    piLock(LOCK_PREFETCH);  // Get the lock
+    hintCount = 0;
+    for (int i = 1; i < n; i++) {
+        int clipId = atoi(word[i]);
+        if (clipId <= 0 || clipId >= CLIP_COUNT) {
+            printf("%s invoked with invalid clipId: \"%s\"; ignored.\n", word[0], word[i]);
+            continue;
+        }
+        hintIds[hintCount++] = clipId;
+    }
+    if (!hintPending) {     // If main loop hasn't yet been told about earlier ones, tell it
+        hintPending = true;
+        postEvent(evPrefetch, 0);
+    }
+    piUnlock(LOCK_PREFETCH);   // Release the lock
+}
+
+/***
+ * 
+ * Command handler for prefetch command
+ * 
+ * prefetch     Show the prefetch hints and how well hints have worked out
+ * prefetch <clipId> ...
+ *              Same as the controller's !prefetch
+ * 
+ ***/
+void onPrefetchKb(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    if (n > 1) {
+        onPrefetch(n, word);
+        return;
+    }
+    if (prefetchCount == 0) {
+        puts("No prefetch hints.");
+    }
+    for (int i = 0; i < prefetchCount; i++) {
+        printf("%2d %-20s rendition %d, %lld KB read ahead%s\n", prefetch[i].clipId, clips[prefetch[i].clipId].name, 
+            prefetch[i].rendition, prefetch[i].bytes / 1024, prefetch[i].clipId == prerollId ? ", pre-rolled" : "");
+    }
+    unsigned long started = prefetchHits + prefetchMisses;
+    if (started == 0) {
+        puts("No clips started while there were hints.");
+        return;
+    }
+    printf("%lu of %lu clips started were hinted (%.0f%%); %lu were pre-rolled.\n", 
+        prefetchHits, started, 100.0 * prefetchHits / started, prerollHits);
+    if (hitSwitches > 0 && missSwitches > 0) {
+        double hitMs = hitSwitchMicros / 1000.0 / hitSwitches;
+        double missMs = missSwitchMicros / 1000.0 / missSwitches;
+        printf("Switch to playing: %.1f ms when hinted, %.1f ms when not; %.0f ms saved in all.\n", 
+            hitMs, missMs, (missMs - hitMs) * hitSwitches);
+    }
+}
+
+/***
+ * 
+ * Command handler for renditions command
+ * 
+ * renditions   Show the frames displayed and dropped in each rendition since startup
+ * 
+ ***/
+void onRenditions(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    for (int r = 0; r < RENDITION_MAX; r++) {
+        long long total = renditionDisplayed[r] + renditionLost[r];
+        printf("Rendition %d: %lld frames, %lld dropped (%.2f%%)\n", 
+            r, total, renditionLost[r], total == 0 ? 0.0 : 100.0 * renditionLost[r] / total);
+    }
+    printf("Recent dropped-frame rate: %.2f%%\n", 100.0 * recentDropRate);
+}
+
+/***
+ * 
+ * powerBench   Measure each thread's wakeups, context switches and CPU time, and the process's 
+ *              resident memory, over secs seconds. Report them and whether they're within the 
+ *              limits for the mode the player was in. Returns true if they were.
+ * 
+ ***/
+bool powerBench(int secs) {
+    static threadSample_t before[BENCH_THREADS], after[BENCH_THREADS];
+    enum playerModes mode = playerMode;
+    printf("Measuring %d seconds in %s mode.\n", secs, modeLimits[mode].name);
+    int nBefore = sampleThreads(before);
+    long long start = microsNow();
+    sleep(secs);
+    int nAfter = sampleThreads(after);
+    double elapsed = (microsNow() - start) / 1000000.0;
+    long ticksPerSec = sysconf(_SC_CLK_TCK);
+    long rss = rssKB();
 
-#define CONTROLLER_TTY  "/dev/ttyACM0"              // The tty we use to talk to the exhibit controller
-#define MAX_LINE_LENGTH (128)                       // The maximum length of a user's input (chars)
-#define MAX_WORDS       (3)                         // The maximum number of words in a command line (chars)
-#define MAX_WSIZE       (20)                        // The maximum length of a word (chars)
-#define SLEEP_MICROS    (10000)                     // Number of uSec to sleep when a little time needs to pass
-#define BANNER          "PTMSC Pinto Abalone Exhibit Media Player v0.1, February 2022"
-#define CMD_SET_VERS    (1000)                      // The version of the command set we speak with the controller
-#define ESCAPE_SEC      (300)                       // Seconds of execution before we stop. Comment out to disable
-#define DEBUG                                       // Uncomment to enable debugginh output
+    double totalWakeups = 0.0, totalPreempts = 0.0, totalCpu = 0.0;
+    printf("%7s %-16s %10s %10s %8s\n", "tid", "thread", "wakeups/s", "preempts/s", "cpu %");
+    for (int a = 0; a < nAfter; a++) {
+        threadSample_t base = {0};                              // Threads that started during the run start at 0
+        for (int b = 0; b < nBefore; b++) {
+            if (before[b].tid == after[a].tid) {
+                base = before[b];
+                break;
+            }
+        }
+        double wakeups = (after[a].wakeups - base.wakeups) / elapsed;
+        double preempts = (after[a].preempts - base.preempts) / elapsed;
+        double cpu = 100.0 * (after[a].cpuTicks - base.cpuTicks) / ticksPerSec / elapsed;
+        printf("%7d %-16s %10.1f %10.1f %8.2f\n", after[a].tid, after[a].name, wakeups, preempts, cpu);
+        totalWakeups += wakeups;
+        totalPreempts += preempts;
+        totalCpu += cpu;
+    }
+    printf("%7s %-16s %10.1f %10.1f %8.2f\n", "", "total", totalWakeups, totalPreempts, totalCpu);
+    printf("Resident memory: %ld KB\n", rss);
 
-// piLock() / piUnlock() usage
-#define LOCK_CLIP       (0)                         // piLock(0) is for changing clips
-#define LOCK_LOOP       (1)                         // piLock(1) is for changing the loop to play when not playing a clip
+    bool pass = true;
+    if (totalWakeups > modeLimits[mode].maxWakeups) {
+        printf("FAIL: %.1f wakeups/s is over the %s limit of %.1f\n", totalWakeups, modeLimits[mode].name, modeLimits[mode].maxWakeups);
+        pass = false;
+    }
+    if (totalCpu > modeLimits[mode].maxCpuPct) {
+        printf("FAIL: %.2f%% CPU is over the %s limit of %.2f%%\n", totalCpu, modeLimits[mode].name, modeLimits[mode].maxCpuPct);
+        pass = false;
+    }
+    if (rss > modeLimits[mode].maxRssKB) {
+        printf("FAIL: %ld KB resident is over the %s limit of %ld KB\n", rss, modeLimits[mode].name, modeLimits[mode].maxRssKB);
+        pass = false;
+    }
+    if (playerMode != mode) {
+        printf("Note: the player changed from %s to %s mode during the run.\n", modeLimits[mode].name, modeLimits[playerMode].name);
+    }
+    printf("powerbench %s\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
 
-// Return codes
-#define RET_OK          (0)                         // Normal end
-#define RET_MICF        (-1)                        // Media item creation failure
-#define RET_MPCF        (-2)                        // Media player creation failure
-#define RET_MPPF        (-3)                        // Media player play failure
-#define RET_KTCF        (-4)                        // Keyboard thread creation failure
-#define RET_CTCF        (-5)                        // Controller thread creation failure
-#define RET_OCTF        (-6)                        // Open controller TTY failure
+/***
+ * 
+ * Command handler for powerbench command
+ * 
+ * powerbench [secs]    Measure the player's idle cost in the mode it's in over secs seconds 
+ *                      (BENCH_SECS if not given); see powerBench(). The keyboard is unresponsive 
+ *                      while it runs.
+ * 
+ ***/
+void onPowerBench(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    int secs = n < 2 ? BENCH_SECS : atoi(word[1]);
+    if (secs <= 0) {
+        puts("powerbench needs a positive number of seconds.");
+        return;
+    }
+    powerBench(secs);
+}
 
 /***
  * 
- * Global variables
+ * Command handler for profile command
+ * 
+ * profile [<secs> [<file>]]    Sample what all the threads are doing for <secs> seconds (default 
+ *                              PROFILE_SECS) and write the folded stacks to <file> (default 
+ *                              PROFILE_PATH). Sending MediaPlayer a SIGUSR2 does the same with 
+ *                              the defaults.
  * 
  ***/
-FILE *ctlIn;                                        // The input stream for the exhibit controller
-FILE *ctlOut;                                       // The output stream for the controller
-libvlc_instance_t * inst;                           // The libVLC engine we'll be using
-libvlc_media_player_t *mp;                          // The media player we'll use
-libvlc_media_t *m[CLIP_COUNT];                      // The clips we'll play represented as media items
-bool running = true;                                // When this goes false (e.g., the stop command), we shut down
-bool isFullscreen =                                 // Whether we display the video in fullscreen mode
-#ifdef DEBUG 
-false; 
-#else 
-true; 
-#endif
+void onProfile(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    int secs = n < 2 ? PROFILE_SECS : atoi(word[1]);
+    if (secs <= 0) {
+        puts("profile needs a positive number of seconds.");
+        return;
+    }
+    profileRun(secs, n < 3 ? PROFILE_PATH : word[2]);
+}
 
-// Inter-thread communication between a thread that wants to change the clip that's playing and 
-// main loop. To change the clip, do a piLock(LOCK_CLIP), then set newClipId to the number of the 
-// desired clip. Then set switchClip to true and do a piUnlock(LOCK_CLIP). The main loop checks 
-// switchClip to determine if someone has set it. If so it does a piLock(LOCK_CLIP), copies 
-// newClipId, sets switchClip to false and  does a piUnlock(LOCK_CLIP). Note that with this 
-// protocol, it's possible to overwrite somebody else's clip change before it's processed. If 
-// that's not what what you want, check switchClip to see that it's false before you change 
-// newClipId.
-int newClipId;
-bool switchClip = false;
-// Inter-thread communication for changing the loop that plays when there's no clip playing. Works 
-// the same way as the above but using piLock(LOCK_LOOP), newLoopId and switchLoop
-int newLoopId;
-bool switchLoop = false;
+/***
+ * 
+ * Command handler for history command
+ * 
+ * history [hours|days|compare|clips [<n>]]
+ *              Show the latency history: the trend over the last <n> (default HISTORY_REPORT) 
+ *              hours or days (the default), the last <n> days compared with the <n> before, or 
+ *              each clip over the last <n> days. "MediaPlayer history ..." does the same from 
+ *              the shell.
+ * 
+ ***/
+void onHistory(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    if (history == NULL) {
+        puts("No history file.");
+        return;
+    }
+    historyReport(history, n < 2 ? "days" : word[1], n < 3 ? HISTORY_REPORT : atoi(word[2]));
+}
 
 /***
  * 
- * Command handler for help command
+ * Command handler for trace command
+ * 
+ * trace [file]     Write the trace to file, or TRACE_PATH if none is given, in Chrome trace 
+ *                  format. Sending MediaPlayer a SIGUSR1 does the same with TRACE_PATH.
  * 
  ***/
-void onHelp(int n, char word[MAX_WORDS][MAX_WSIZE]) {
-    puts(
-        "help           Type this help text.\n"
-        "h              Same as help\n"
-    );
-    puts(
-        "play <cName>   Play clip with name <cName>"
-        "stop           Shutdown the media player\n"
-    );
+void onTrace(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    traceWrite(n < 2 ? TRACE_PATH : word[1]);
 }
 
 /***
  * 
- * Command handler for play command
+ * Command handler for vlclog command
+ * 
+ * vlclog                   Show the recent VLC log messages
+ * vlclog module level      Set the minimum level of the VLC log messages kept from module to 
+ *                          level, one of debug, notice, warning, error or off. If module is 
+ *                          "*", set it for all modules without a level of their own.
  * 
- * play cName   Play clip cName; where cName is one of
- *              the clips[].name entries
  ***/
-void onPlay(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+void onVlcLogCmd(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    static const char *levelName[] = {"debug", "", "notice", "warning", "error", "off"};
     if (n < 2) {
-        puts("Clip name not specified.\n");
+        vlcLogDump();
         return;
     }
-    for (int cNo = 0; cNo < CLIP_COUNT; cNo++) {
-        if (strcmp(word[1], clips[cNo].name) == 0) {
-            piLock(LOCK_CLIP);      // Get the lock
-            newClipId = cNo;
-            switchClip = true;
-            piUnlock(LOCK_CLIP);    // Release the lock
-            return;
+    int level = -1;
+    for (int l = 0; l <= LIBVLC_ERROR + 1; l++) {
+        if (n >= 3 && levelName[l][0] != '\0' && strcmp(word[2], levelName[l]) == 0) {
+            level = l;
         }
     }
-    printf("No clip named \"%s\"\n", word[1]);
+    if (level < 0) {
+        puts("vlclog needs a module and one of debug, notice, warning, error or off.");
+        return;
+    }
+    if (strcmp(word[1], "*") == 0) {
+        vlcLogLevel = level;
+        printf("VLC log level set to %s.\n", levelName[level]);
+        return;
+    }
+    int slot = -1;
+    for (int i = 0; i < VLCLOG_FILTERS; i++) {
+        if (strcmp(vlcLogFilter[i].module, word[1]) == 0) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && vlcLogFilter[i].module[0] == '\0') {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        printf("Can't set levels for more than %d VLC modules.\n", VLCLOG_FILTERS);
+        return;
+    }
+    vlcLogFilter[slot].level = level;                           // Level first; the module name makes it live
+    strncpy(vlcLogFilter[slot].module, word[1], VLCLOG_MOD_MAX - 1);
+    printf("VLC log level for %s set to %s.\n", vlcLogFilter[slot].module, levelName[level]);
 }
 
 /***
  * 
- * Command handler for the !playClip command, issued by controller
+ * Command handler for audio command
+ * 
+ * audio        Show how long clips' sound took to start after a switch, how many dropouts there were 
+ *              and how far off its pts the sound got
  * 
- * !playClip clipId
- *      Play the clip whose clip id -- the index into 
- *      clips[] -- is clipId
  ***/
-void onPlayClip(int n, char word[MAX_WORDS][MAX_WSIZE]) {
-    int clipId = 0;
-    if (n < 2) {
-        puts("!playClip inviked with no clipId specified; used 0.\n");
+void onAudio(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    #ifdef PERSISTENT_AUDIO
+    if (pcm == NULL) {
+        printf("Audio output: opened by VLC for each clip (%s wouldn't open).\n", AUDIO_DEVICE);
     } else {
-        clipId = atoi(word[1]);
-        if (clipId < 0 || clipId >= CLIP_COUNT) {
-            printf("!playClip inviked with invalid clipId: \"%s\"; used .", word[1]);
-            clipId = 0;
-        }
+        printf("Audio output: %s, kept open for MediaPlayer's whole life, %d ms buffer.\n", AUDIO_DEVICE, 
+            audioBufferMs);
+        printf("Sound was up to %.1f ms off its pts; %.1f ms of silence held early sound back and %.1f ms of " 
+            "late sound was dropped.\n", audioOffsetMaxMicros / 1000.0, audioPadFrames * 1000.0 / AUDIO_RATE, 
+            audioDropFrames * 1000.0 / AUDIO_RATE);
+    }
+    #else
+    puts("Audio output: opened by VLC for each clip.");
+    #endif
+    if (switchCount == 0) {
+        puts("No clip switches yet.");
+        return;
     }
-    piLock(LOCK_CLIP);      // Get the lock
-    newClipId = clipId;
-    switchClip = true;
-    piUnlock(LOCK_CLIP);    // Release the lock
+    if (audioStarts > 0) {
+        printf("Sound reached the device %.1f ms after a switch on average, %.1f ms at most (%lu switches).\n", 
+            audioStartTotalMicros / 1000.0 / audioStarts, audioStartMaxMicros / 1000.0, audioStarts);
+    }
+    unsigned long most = clipUnderruns > clipUnderrunsMax ? clipUnderruns : clipUnderrunsMax;
+    printf("%lu dropouts, %.2f per switch, %lu at most in one clip; VLC lost %lld audio buffers.\n", 
+        audioUnderruns, (double)audioUnderruns / switchCount, most, audioLost);
 }
 
 /***
  * 
- * Command handler for !setLoop command, issued by controller
+ * Command handler for surface command
+ * 
+ * surface      Show how many clip switches needed a new video output and what switching costs
  * 
- * !setLoop clipId
- *      Set the video loop to be played when we're not playing something else
- *      to the clip whose id -- the index into clips[] -- is clipId. 
- *      If a loop is already playing, switch to playing this loop instead.
  ***/
-void onSetLoop(int n, char word[MAX_WORDS][MAX_WSIZE]) {
-    int clipId = 0;
-    if (n < 2) {
-        puts("!setLoop invoked with no clipId specified; used 0.\n");
-    } else {
-        clipId = atoi(word[1]);
-        if (clipId < 0 || clipId >= CLIP_COUNT) {
-            printf("!setLoop invoked with invalid clipId: \"%s\"; used 0.", word[1]);
-            clipId = 0;
-        }
+void onSurface(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    #ifdef PERSISTENT_SURFACE
+    puts(xDisplay != NULL ? "Video surface: one window, kept for MediaPlayer's whole life." : 
+        "Video surface: VLC's own windows (no X display for ours).");
+    #elif defined(COMPOSITOR)
+    puts("Video surface: the compositor's framebuffer.");
+    #else
+    puts("Video surface: VLC's own windows.");
+    #endif
+    if (switchCount == 0) {
+        puts("No clip switches yet.");
+        return;
     }
-    piLock(LOCK_LOOP);      // Get the lock
-    newLoopId = clipId;
-    switchLoop = true;
-    piUnlock(LOCK_LOOP);    // Release the lock
+    printf("%lu clip switches; %lu needed a new video output.\n", switchCount, voutCount);
+    if (voutCount > 0) {
+        double avg = voutTotalMicros / 1000.0 / voutCount;
+        printf("New video output up after %.1f ms on average, %.1f ms at most; %.1f ms saved on the %lu that reused one.\n", 
+            avg, voutMaxMicros / 1000.0, avg * (switchCount - voutCount), switchCount - voutCount);
+    }
+    printf("Switch to playing: %.1f ms on average, %.1f ms at most.\n", 
+        switchTotalMicros / 1000.0 / switchCount, switchMaxMicros / 1000.0);
+}
+
+/***
+ * 
+ * Command handler for startup command
+ * 
+ * startup      Show how long each phase of startup took
+ * 
+ ***/
+void onStartup(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+    showStartup();
 }
 
 /***
@@ -224,6 +3911,7 @@ void onSetLoop(int n, char word[MAX_WORDS][MAX_WSIZE]) {
 void onStop(int n, char word[MAX_WORDS][MAX_WSIZE]) {
     puts("Stopping\n");
     running = false;
+    postEvent(evStop, 0);                                       // Wake main loop so it notices
 }
 
 /***
@@ -235,12 +3923,16 @@ void onStop(int n, char word[MAX_WORDS][MAX_WSIZE]) {
  *
  ***/
  void onToggleFS(int n, char word[MAX_WORDS][MAX_WSIZE]) {
+     #ifdef COMPOSITOR
+     puts("Ignoring !toggleFS command; the compositor always draws full screen.");
+     return;
+     #endif
      if (mp == NULL) {
          puts("Ignoring !toggleFS command; no media player defined.");
          return;
      }
      isFullscreen = !isFullscreen;
-     libvlc_set_fullscreen(mp, isFullscreen);
+     setFullscreen(isFullscreen);
      printf("Screen mode set to %s.\n", isFullscreen ? "full" : "window");
  }
 
@@ -265,18 +3957,44 @@ typedef struct cmd_t {
 // The registry of keyboard-issued commands aimed at MediaPlayer. 
 // The last command must be {"__END__", NULL}.
 cmd_t kbRegistry[] = {
+    {"audio", onAudio},
+    {"blendbench", onBlendBench},
+    #ifdef COMPOSITOR
+    {"crossfade", onCrossfade},
+    #endif
     {"help", onHelp},
     {"h",    onHelp},
+    {"history", onHistory},
+    {"lang", onLangKb},
+    {"overlay", onOverlayKb},
     {"play", onPlay},
+    {"powerbench", onPowerBench},
+    {"prefetch", onPrefetchKb},
+    {"profile", onProfile},
+    {"renditions", onRenditions},
+    {"scrub", onScrub},
+    {"sfx",  onSfx},
+    {"startup", onStartup},
     {"stop", onStop},
+    {"surface", onSurface},
+    {"trace", onTrace},
+    {"vlclog", onVlcLogCmd},
     {"__END__", NULL}
 };
 
 // The registry of controller-issued commands aimed at MediaPlayer. 
 // The last command must be {"__END__", NULL}.
 cmd_t controllerRegistry[] = {
+    #ifdef COMPOSITOR
+    {"!crossfade", onCrossfade},
+    #endif
+    {"!lang", onLang},
+    {"!overlay", onOverlay},
     {"!playClip", onPlayClip},
+    {"!prefetch", onPrefetch},
+    {"!scrub", onScrub},
     {"!setLoop", onSetLoop},
+    {"!sfx", onSfx},
     {"!stop", onStop},
     {"!toggleFS", onToggleFS},
     {"!version", onVersion},
@@ -289,9 +4007,16 @@ cmd_t controllerRegistry[] = {
  * 
  ***/
 void doCommand(char line[], cmd_t registry[]) {
-    char word[3][20];
-    int nparms = sscanf(line, "%20s %20s %20s", word[0], word[1], word[2]);
-    if (nparms != EOF) {
+    char word[MAX_WORDS][MAX_WSIZE];
+    int nparms = 0;
+    int used;
+    char *next = line;
+    while (nparms < MAX_WORDS && sscanf(next, "%19s%n", word[nparms], &used) == 1) {  // 19 is MAX_WSIZE - 1
+        next += used;
+        nparms++;
+    }
+    if (nparms != 0) {
+        traceEvent(trCommand, line, nparms, 0);
         for (int i = 0; registry[i].handler != NULL; i++) {
             if (strcmp(registry[i].cmd, word[0]) == 0) {
                 (registry[i].handler)(nparms, word);
@@ -306,17 +4031,23 @@ void doCommand(char line[], cmd_t registry[]) {
  * keyboardThread -- communicate with someone at the keyboard on stdin and stdout via 
  * a simple, application-specific commandline
  * 
- * Commands up to three white-space-separated words, the first of which is the name of the
+ * Commands up to MAX_WORDS white-space-separated words, the first of which is the name of the
  * command to be executed. The others, if any, are the parameters passed to the command.
  * 
  ***/
 PI_THREAD(keyboardThread) {
     static char buffer[MAX_LINE_LENGTH];
+    prctl(PR_SET_NAME, "keyboard");                 // So it can be told apart in /proc and by powerbench
     printf("> ");
     while (1==1){
         if (fgets(buffer, sizeof(buffer), stdin) != NULL) {
             // Send commands beginning with '!' to controller (minus the '!'); others are local
             if (buffer[0] == '!') {
+                if (ctlOut == NULL) {
+                    puts("Controller link isn't up yet.");
+                    printf("> ");
+                    continue;
+                }
                 printf("Sending \"%s\" to controller", &buffer[1]);
                 fprintf(ctlOut, &buffer[1]);
             } else {
@@ -327,6 +4058,45 @@ PI_THREAD(keyboardThread) {
     }
 }
 
+/***
+ * 
+ * openController -- get the connections to the exhibit controller (ctlIn and ctlOut) going. 
+ * Returns RET_OK or the return code MediaPlayer should exit with.
+ * 
+ ***/
+int openController() {
+    // ctlIn needs line buffering mode and no echoing of characters
+    FILE *in = fopen(CONTROLLER_TTY, "r");
+    if (in == NULL) {
+        printf("Failed to open ctlIn. Error: %s\n", strerror(errno));
+        return RET_OCTF;
+    }
+    if (setvbuf(in, NULL, _IOLBF, MAX_LINE_LENGTH) != 0) {
+        printf("Failed to set ctlIn buffer mode. Error: %s\n", strerror(errno));
+        return RET_OCTF;
+    }
+    struct termios t;
+    if (tcgetattr(fileno(in), &t) != 0) {
+        printf("Failed to get termios for ctlIn. Error: %d, (%s)\n", errno, strerror(errno));
+        return RET_OCTF;
+    }
+    t.c_lflag &= ~ECHO;
+    if (tcsetattr(fileno(in), TCSANOW, &t) != 0) {
+        printf("Failed to set termios for ctlIn. Error: %d, (%s)\n", errno, strerror(errno));
+        return RET_OCTF;
+    }
+
+    // ctlOut needs append mode
+    FILE *out = fopen(CONTROLLER_TTY, "a");
+    if (out == NULL) {
+        printf("Failed to open ctlOut. Error: %s\n", strerror(errno));
+        return RET_OCTF;
+    }
+    ctlIn = in;
+    ctlOut = out;
+    return RET_OK;
+}
+
 /***
  * 
  * controllerThread -- get input from the exhibit controller. Echo whatever it says to stdout, 
@@ -334,192 +4104,336 @@ PI_THREAD(keyboardThread) {
  * directed at MediaPlayer, to be executed using the same sort of mechanism (and the same handler 
  * signatures) and the keyboard commands.
  * 
+ * The link to the controller is set up here, rather than in main, so that it happens while main 
+ * is getting VLC going. If it can't be, MediaPlayer stops.
+ * 
  ***/
 PI_THREAD(controllerThread) {
     char buffer[MAX_LINE_LENGTH];
+    prctl(PR_SET_NAME, "controller");               // So it can be told apart in /proc and by powerbench
+
+    phaseTime[phLink].begin = microsNow();
+    int ret = openController();
+    phaseTime[phLink].end = microsNow();
+    if (ret != RET_OK) {
+        exitCode = ret;
+        running = false;
+        postEvent(evStop, 0);
+        return NULL;
+    }
 
     while (1==1) {
         if (fgets(buffer, sizeof(buffer), ctlIn) != NULL) {
             printf("[controller] %s", buffer);
+            traceEvent(trController, buffer, 0, 0);
             if (buffer[0] == '!') {
+                long long sent = linkSentMicros;
+                if (sent != 0) {
+                    linkSentMicros = 0;
+                    historyNote(hmLinkRtt, -1, microsNow() - sent);
+                }
                 doCommand(buffer, controllerRegistry);
             }
         }
     }
 }
 
+/***
+ * 
+ * signalThread -- wait for signals and deal with them. Doing it here rather than in a signal 
+ * handler means what's done about a signal isn't limited to what's safe in one. SIGUSR1 dumps the 
+ * trace and SIGUSR2 takes a profile, both right here: traceWrite() reads the ring without locking 
+ * anything, so the trace can be had even when main loop is stuck, and a profile is just a matter 
+ * of waiting.
+ * 
+ ***/
+PI_THREAD(signalThread) {
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGUSR1);
+    sigaddset(&sigs, SIGUSR2);
+    prctl(PR_SET_NAME, "signals");
+    while (1==1) {
+        int sig;
+        if (sigwait(&sigs, &sig) == 0) {
+            if (sig == SIGUSR1) {
+                traceWrite(TRACE_PATH);
+            } else if (sig == SIGUSR2) {
+                profileRun(PROFILE_SECS, PROFILE_PATH);
+            }
+        }
+    }
+}
+
+/***
+ * 
+ * benchThread -- when run as "MediaPlayer powerbench", do what the controller would to put the 
+ * player in each of its modes, measure each for benchSecs seconds and then stop MediaPlayer, 
+ * with exitCode saying whether every mode was within its limits.
+ * 
+ ***/
+PI_THREAD(benchThread) {
+    prctl(PR_SET_NAME, "bench");
+    bool pass = true;
+    for (int mode = waitingMode; mode < MODE_COUNT; mode++) {
+        if (mode == loopingMode) {
+            postEvent(evSetLoop, BENCH_LOOP_ID);
+        } else if (mode == playingMode) {
+            postEvent(evPlayClip, BENCH_CLIP_ID);
+        }
+        sleep(BENCH_SETTLE_SECS);                               // Let the switch's one-off costs pass
+        if (playerMode != mode) {
+            printf("FAIL: the player didn't get into %s mode.\n", modeLimits[mode].name);
+            pass = false;
+            continue;
+        }
+        pass = powerBench(benchSecs) && pass;
+    }
+    printf("powerbench %s in all modes\n", pass ? "PASS" : "FAIL");
+    exitCode = pass ? RET_OK : RET_PBFF;
+    running = false;
+    postEvent(evStop, 0);
+    return NULL;
+}
+
 /***
  * 
  * main     What gets called to kick things off and returns to shut things down
  * 
  ***/
 int main(int argc, char* argv[]) {
-    int reqClipId;                                  // The id of the requested clip; 0 if none
-    int reqLoopId = 0;                              // The id of the clip that plays when no clip is playing
-    int nowPlayingId = 0;                           // The id of the clip the media player was last started on
+    // "MediaPlayer history ..." is a query of the history file, not a media player
+    if (argc > 1 && strcmp(argv[1], "history") == 0) {
+        historyFile_t *h = historyMap(HISTORY_PATH, false);
+        if (h == NULL) {
+            return RET_HSTF;
+        }
+        historyReport(h, argc > 2 ? argv[2] : "days", argc > 3 ? atoi(argv[3]) : HISTORY_REPORT);
+        munmap(h, sizeof(historyFile_t));
+        return RET_OK;
+    }
+    // "MediaPlayer powerbench [<secs>]" runs the player, but under benchThread's control
+    if (argc > 1 && strcmp(argv[1], "powerbench") == 0) {
+        benchSecs = argc > 2 ? atoi(argv[2]) : BENCH_SECS;
+        if (benchSecs <= 0) {
+            puts("powerbench needs a positive number of seconds.");
+            return RET_PBFF;
+        }
+    }
+
+    mainMicros = microsNow();
+    FILE *uptime = fopen("/proc/uptime", "r");      // For telling how long after a power cycle the screen is live
+    if (uptime != NULL) {
+        if (fscanf(uptime, "%lf", &uptimeAtMain) != 1) {
+            uptimeAtMain = 0.0;
+        }
+        fclose(uptime);
+    }
 
     // Show we're alive
     puts(BANNER);
     puts("Type \"help\" for list of commands");
 
+    // Set up main loop's event queue. Its timers are in microsNow() time, i.e., CLOCK_MONOTONIC.
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&eventReady, &ca);
+
+    // Get the signal thread going. SIGUSR1 and SIGUSR2 are blocked here so that every thread started 
+    // from now on, including libVLC's, has them blocked too, and they're only ever taken by signalThread.
+    phaseTime[phSignals].begin = microsNow();
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGUSR1);
+    sigaddset(&sigs, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+    if (piThreadCreate(signalThread) != 0) {
+        puts("Failed to create signal thread.");
+        return RET_STCF;
+    }
+    phaseTime[phSignals].end = microsNow();
+
     // Get the keyboard input thread going. All stdin activity is done on keyboardThread
     // stdout and ctlOut activity can be done by any thread.
+    phaseTime[phKeyboard].begin = microsNow();
     if (piThreadCreate(keyboardThread) != 0) {
         puts("Failed to create keyboard thread.");
         return RET_KTCF;
     }
+    phaseTime[phKeyboard].end = microsNow();
 
-    // Get the connections to the exhibit controller (ctlIn and ctlOut) going
-    // ctlIn needs line buffering mode and no echoing of characters
-    ctlIn = fopen(CONTROLLER_TTY, "r");
-    if (ctlIn == NULL) {
-        printf("Failed to open ctlIn. Error: %s\n", strerror(errno));
-        return RET_OCTF;
-    }
-    if (setvbuf(ctlIn, NULL, _IOLBF, MAX_LINE_LENGTH) != 0) {
-        printf("Failed to set ctlIn buffer mode. Error: %s\n", strerror(errno));
-        return RET_OCTF;
-    }
-    struct termios t;
-    if (tcgetattr(ctlIn->_fileno, &t) != 0) {
-        printf("Failed to get termios for ctlIn. Error: %d, (%s)\n", errno, strerror(errno));
-        return RET_OCTF;
-    }
-    t.c_lflag &= ~ECHO;
-    if (tcsetattr(ctlIn->_fileno, TCSANOW, &t) != 0) {
-        printf("Failed to set termios for ctlIn. Error: %d, (%s)\n", errno, strerror(errno));
-        return RET_OCTF;
-    }
-
-    // ctlOut needs append mode
-    ctlOut = fopen(CONTROLLER_TTY, "a");
-    if (ctlOut == NULL) {
-        printf("Failed to open ctlOut. Error: %s\n", strerror(errno));
-        return RET_OCTF;
-    }
+    // Get the history file mapped. Without it, MediaPlayer works; it just doesn't keep a history.
+    phaseTime[phHistory].begin = microsNow();
+    history = historyMap(HISTORY_PATH, true);
+    phaseTime[phHistory].end = microsNow();
 
-    // Get the controller thread going all ctlIn activity is done on controllerThread
-    if (piThreadCreate(controllerThread) != 0) {
+    // Get the controller thread going. It sets up the link to the controller (ctlIn and ctlOut) 
+    // while we carry on here. All ctlIn activity is done on controllerThread.
+    phaseTime[phController].begin = microsNow();
+    if (benchSecs > 0) {
+        puts("Running powerbench; not talking to the controller.");
+    } else if (piThreadCreate(controllerThread) != 0) {
         puts("Failed to create controller thread.");
         return RET_CTCF;
     }
+    phaseTime[phController].end = microsNow();
 
     // Set things up to play the exhibit's media
+    phaseTime[phEngine].begin = microsNow();
+    #ifdef PERSISTENT_SURFACE
+    XInitThreads();                                             // Xlib must know it's multithreaded before anything uses it
+    #endif
     inst = libvlc_new(0, NULL);
+    libvlc_log_set(inst, onVlcLog, NULL);                       // Keep VLC's log in the ring, not on stderr
+    phaseTime[phEngine].end = microsNow();
 
+    phaseTime[phMedia].begin = microsNow();
     for (int cNo = 0; cNo < CLIP_COUNT; cNo++) {
+        for (int r = 0; r < RENDITION_MAX && clips[cNo].file[r][0] != '\0'; r++) {
+            char path[sizeof(MEDIA_PATH) + CLIP_FILE_MAX] = MEDIA_PATH;
+            strcat(path, clips[cNo].file[r]);
+            if (r > 0 && access(path, R_OK) != 0) {             // Lesser renditions are optional; skip missing ones
+                printf("Clip %d rendition %d (%s) not found. Skipping it.\n", cNo, r, clips[cNo].file[r]);
+                continue;
+            }
+            m[cNo][r] = libvlc_media_new_path(inst, path);      // Make a media item pointing to MEDIA_PATH
+            if (m[cNo][r] == NULL) {                            // Check that it worked
+                printf("Failed to create clip media item %d rendition %d\n", cNo, r);
+                return RET_MICF;
+            }
+        }
+    }
+    for (int pNo = 0; pNo < SCRUB_PROXY_COUNT; pNo++) {
         char path[sizeof(MEDIA_PATH) + CLIP_FILE_MAX] = MEDIA_PATH;
-        strcat(path, clips[cNo].file);
-        m[cNo] = libvlc_media_new_path(inst, path);             // Make a media item pointing to MEDIA_PATH
-        if (m[cNo] == NULL) {                                   // Check that it worked
-            printf("Failed to create clip media item %d\n", cNo);
-            return RET_MICF;
+        strcat(path, scrubProxies[pNo].file);
+        if (access(path, R_OK) == 0) {                          // Proxies are optional; skip missing ones
+            mProxy[scrubProxies[pNo].clipId] = libvlc_media_new_path(inst, path);
         }
     }
+    phaseTime[phMedia].end = microsNow();
 
     // Instantiate the media player
+    phaseTime[phPlayer].begin = microsNow();
+    #ifdef COMPOSITOR
+    int compRet = compInit();
+    if (compRet != RET_OK) {
+        return compRet;
+    }
+    mp = deck[activeDeck].mp;
+    attachPlayerEvents(deck[0].mp, 0);
+    attachPlayerEvents(deck[1].mp, 1);
+    overlayInit(deck[0].mp);
+    overlayInit(deck[1].mp);
+    #else
     mp = libvlc_media_player_new(inst);
     if (mp == NULL) {
         puts("Failed to create media player");
         return RET_MPCF;
     }
-    puts("Ready to go. Waiting word from controller.");
-    while (!switchLoop && !switchClip && running) {
-        usleep(SLEEP_MICROS);                                   // Wait for controller to kick things off (or stop command)
+    attachPlayerEvents(mp, 0);
+    overlayInit(mp);
+    #endif
+    phaseTime[phPlayer].end = microsNow();
+    phaseTime[phSurface].begin = microsNow();
+    int surfRet = surfaceInit(mp);
+    if (surfRet != RET_OK) {
+        return surfRet;
     }
+    phaseTime[phSurface].end = microsNow();
+    phaseTime[phAudio].begin = microsNow();
+    int audioRet = audioInit();
+    if (audioRet != RET_OK) {
+        return audioRet;
+    }
+    #ifdef COMPOSITOR
+    attachAudio(deck[0].mp, 0);
+    attachAudio(deck[1].mp, 1);
+    #else
+    attachAudio(mp, 0);
+    #endif
+    phaseTime[phAudio].end = microsNow();
 
-    // Main loop. Do until running goes false
-    // There are three key variables here. reqLoopId, the id of the looping clip to play (0 if none) when there no specific 
-    // clip has been requested; reqClipId, the id of the last specifically requested clip (0 if none); and nowPlayingId, the 
-    // id of the clip the media player was last tasked to play.
-    // There are two types of clips that can be requested, playOnce and PlayThrough. playOnce clips should be interrupted
-    // if they are playing when a new request is received. A playThrough clip plays to the end before a newly requested clip
-    // starts.
-    while (running) {
-        if (switchLoop) {                                           // If we've been told to switch which clip is the looping one
-            int oldLoopId = reqLoopId;
-            piLock(LOCK_LOOP);                                      //   Do the ritual to update what the requested looping clip is
-            reqLoopId = newLoopId;
-            switchLoop = false;
-            piUnlock(LOCK_LOOP);
-            if (reqLoopId < 0 || reqLoopId >= sizeof(clips) / sizeof(clips[0])) {
-                printf("Controller asked for non-existant loop: %d. Ignoring request.\n", reqLoopId);
-                reqLoopId = oldLoopId;
-            } else if (clips[reqLoopId].type != loop) {             //  Otherwise if the new requested clip isn't looping, ignore the request
-                printf("Ignoring request to loop non-looping clip %s\n", clips[reqLoopId].name);
-                reqLoopId = oldLoopId;
-            } else {                                                //   Otherwise (make the switch to the new one)
-                if (nowPlayingId == oldLoopId) {                    //     If current clip that's playing is the old looping clip
-                    nowPlayingId = reqLoopId;                       //       Swap out the old looping clip with the new one
-                    libvlc_media_player_pause(mp);                  //       Pause the playing (so the player is out of work)
-                }
-                printf("Switching looping clip to %d (%s)\n", reqLoopId, clips[reqLoopId].name);
-            }
-        }
-        if (switchClip && reqClipId == 0) {                         // If we've been told to play a new clip and there's not one already queued
-            int oldClipId = reqClipId;
-            piLock(LOCK_CLIP);                                      //   Do the ritual to switch which clip is current
-            reqClipId = newClipId;
-            switchClip = false;
-            piUnlock(LOCK_CLIP);
-            printf("Switching to clip %d (%s)\n", reqClipId, clips[reqClipId].name);
-            if (reqClipId < 0 || reqClipId >= sizeof(clips) / sizeof(clips[0])) {
-                printf("Controller asked for non-existent clip: %d. Ignoring request.\n", reqClipId);
-                reqClipId - oldClipId;
-            } else if (clips[nowPlayingId].type != fullPlay && libvlc_media_player_is_playing(mp)) {
-                                                                    //   If what's playing is interruptable and the media player is playing
-                libvlc_media_player_pause(mp);                      //     Pause the player (so that it's out of work)
-            }
-            #ifdef TRAP
-            if (reqClipId == 3) {                                   //  if it's "abandonedClip"
-                running = false;                                    //    Bail
-            }
-            #endif
+    // Get something on the screen without waiting for the controller
+    #ifdef DEFAULT_LOOP_ID
+    if (benchSecs == 0) {                                       // powerbench starts by measuring waiting mode
+        playerEvent_t loopEvent = {evSetLoop, DEFAULT_LOOP_ID, microsNow()};
+        dispatch(&loopEvent);                                   // Now, not once main loop gets going
+    }
+    #endif
+
+    // Things nothing on the screen depends on
+    phaseTime[phSfx].begin = microsNow();
+    loadSfx();
+    phaseTime[phSfx].end = microsNow();
+
+    puts("Ready to go. Waiting word from controller.");
+    if (benchSecs > 0) {                                        // It stops MediaPlayer when it's done
+        if (piThreadCreate(benchThread) != 0) {
+            puts("Failed to create powerbench thread.");
+            return RET_PBFF;
         }
+    } else {
         #ifdef ESCAPE_SEC
-        //Escape hatch
-        if (clock() / CLOCKS_PER_SEC >= ESCAPE_SEC) {
-            puts("Stopping: Escape hatch activated.");
-            running = false;
-        } else
+        setTimer(evEscape, microsNow() + ESCAPE_SEC * 1000000LL);  // Escape hatch
         #endif
-        if (!libvlc_media_player_is_playing(mp)) {                  // If the player is out of work
-            if (clips[nowPlayingId].type != loop) {                 //   If what's been playing a looping clip (i.e., it was requested)
-                printf("Finished clip %d (%s)\n", nowPlayingId, clips[nowPlayingId].name);
-                fprintf(ctlOut, "!videoEnds\n");                    //     Let the controller know the clip finished
-                if (ferror(ctlOut)) {
-                    printf("!videoEnds fprintf error: %s\n", strerror(errno));
-                }
-            }
-            if (reqClipId != 0) {                                   //   If there's a requested clip pending
-                nowPlayingId = reqClipId;                           //     Switch to the requested clip
-                reqClipId = 0;                                      //     Mark that we've go it handled
-                printf("Starting clip %d (%s)\n", nowPlayingId, clips[nowPlayingId].name);
-            } else {                                                //   Otherwise (there wasn't a pending clip play request)
-                nowPlayingId = reqLoopId;                           //     Play the looping clip
-            }
-            libvlc_media_player_set_media(mp, m[nowPlayingId]);     //   Tell the player we want to play the nowPlayingId clip
-            if (libvlc_media_player_play(mp) != 0) {                //   Try to start playing the clip. If that fails
-                libvlc_set_fullscreen(mp, false);                   //     Get out of fullscreen mode
-                puts("Failed to start clip. Stopping");             //     Bail out
-                running = false;
-            }
-            while (!libvlc_media_player_is_playing(mp)) {           //   Spin until it gets going
-                usleep(SLEEP_MICROS);
-            }
+    }
+
+    // Main loop. Do until running goes false. Wait for something to happen and then do what the 
+    // transition table says to about it. See transitions[] for the details.
+    bool startupShown = false;
+    while (running) {
+        playerEvent_t e;
+        nextEvent(&e);
+        dispatch(&e);
+        if (!startupShown && firstFrameMicros != 0) {           // Show what it took to get video on the screen
+            startupShown = true;
+            showStartup();
         }
-        usleep(SLEEP_MICROS);                                       // Mostly, we sleep
     }
 
     puts("Cleaning up.");
     // Quitting time. Clean up after ourselves
     for (int cNo = 0; cNo < CLIP_COUNT; cNo++) {    // Release the media items
-        libvlc_media_release (m[cNo]);
+        for (int r = 0; r < RENDITION_MAX; r++) {
+            if (m[cNo][r] != NULL) {
+                libvlc_media_release (m[cNo][r]);
+            }
+        }
+        if (mProxy[cNo] != NULL) {
+            libvlc_media_release (mProxy[cNo]);
+        }
     }
     libvlc_media_player_stop(mp);                   // Stop the media player
-    libvlc_set_fullscreen(mp, false);               // Take it out of fullscreen mode
+    setFullscreen(false);                           // Take it out of fullscreen mode
     libvlc_media_player_release(mp);                // Release it
+    #ifdef PERSISTENT_SURFACE
+    if (xDisplay != NULL) {
+        XDestroyWindow(xDisplay, xWindow);          // Then the window it drew in
+        XCloseDisplay(xDisplay);
+    }
+    #endif
+    #ifdef PERSISTENT_AUDIO
+    if (pcm != NULL) {
+        snd_pcm_close(pcm);                         // And the audio device it played through
+    }
+    #endif
+    #ifdef COMPOSITOR
+    libvlc_media_player_stop(deck[1 - activeDeck].mp);  // Same for the compositor's other deck
+    libvlc_media_player_release(deck[1 - activeDeck].mp);
+    munmap(fb, fbSize);
+    #endif
+    // The sound effects' threads may be in the middle of a write, so their device handles and 
+    // samples are left for the process's exit to let go of
+    if (history != NULL) {                          // Get the history onto the SD card and let go of it
+        pthread_mutex_lock(&historyLock);
+        msync(history, sizeof(historyFile_t), MS_SYNC);
+        munmap(history, sizeof(historyFile_t));
+        history = NULL;
+        pthread_mutex_unlock(&historyLock);
+    }
+    libvlc_log_unset(inst);                         // Stop logging into the ring
     libvlc_release(inst);                           // Then release the engine
     puts("Exiting MediaPlayer");
-    return RET_OK;                                  // End normally
+    return exitCode;                                // End normally, unless something went wrong
 }
\ No newline at end of file
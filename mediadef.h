@@ -14,6 +14,46 @@
  * through only once and so on. A clip description is of clip_t. The complete 
  * collection of clips in the video file is in the array named clips.
  * 
+ * A clip can come in up to RENDITION_MAX renditions: the same clip encoded at 
+ * successively lower resolution or bitrate. The first one listed is the full 
+ * quality version; the rest, if any, are used when the Pi is running hot or 
+ * dropping frames. Unused entries are left empty, and lesser renditions whose 
+ * files aren't on the card are skipped at startup.
+ * 
+ * A clip's type says whether it loops and whether it can be interrupted. Any 
+ * clip other than a fullPlay one can also be made uninterruptible for the 
+ * first guardMs ms after it starts. While a clip can't be interrupted, clips 
+ * requested are held: by default a new request replaces one already waiting, 
+ * but with queuePending they wait their turn in order. Finally, a request for 
+ * a clip with a higher priority than the one playing interrupts it no matter 
+ * what. These three are zero -- no guard, replacePending, priority 0 -- for 
+ * clips that don't list them.
+ * 
+ * Clips that visitors can scrub through with a dial (the !scrub command) may 
+ * also have a scrub proxy: the same clip encoded with every frame a keyframe 
+ * (e.g., ffmpeg -g 1), so seeking to any position is quick. These are listed 
+ * in the array scrubProxies. A proxy whose file isn't present is ignored and 
+ * the clip itself is scrubbed instead.
+ * 
+ * It also describes the sound effects the controller can play over whatever 
+ * clip is showing. A sound effect is a short 16-bit PCM .wav file whose 
+ * samples are read into memory at startup so that it can be started quickly. 
+ * The sound effects are in the array named sfx and are referred to by name.
+ * 
+ * A clip's file may carry more than one audio track, each tagged with the 
+ * language it's in (e.g., ffmpeg -metadata:s:a:1 language=spa). The 
+ * languages visitors can choose among with the !lang command are in the array 
+ * named languages, the first of which is the one used until a !lang says 
+ * otherwise. A clip with no track in the chosen language plays its default 
+ * one.
+ * 
+ * Finally, it describes the badges the controller can have shown over the 
+ * video with the !overlay command: small images (typically a .png with 
+ * transparency), such as a site number, in the array named badges and 
+ * referred to by name. Together with overlaid text, these let one base clip 
+ * stand in for variants that differ only in the message shown, like the 
+ * three score clips.
+ * 
  ***
  * 
  * Copyright (C) 2020-2022 D.L. Ehnebuske
@@ -44,6 +84,13 @@
 #define CLIP_COUNT      (sizeof(clips) / sizeof(clips[0]))  // Number of clips we have
 #define CLIP_NAME_MAX   (18)                                // Maximum number of chars in clip_t name
 #define CLIP_FILE_MAX   (30)                                // Maximum number of chars in clip_t file
+#define RENDITION_MAX   (3)                                 // Maximum number of renditions of a clip
+#define SCRUB_PROXY_COUNT (sizeof(scrubProxies) / sizeof(scrubProxies[0])) // Number of scrub proxies
+#define SFX_COUNT       (sizeof(sfx) / sizeof(sfx[0]))      // Number of sound effects we have
+#define SFX_NAME_MAX    (18)                                // Maximum number of chars in sfx_t name
+#define BADGE_COUNT     (sizeof(badges) / sizeof(badges[0])) // Number of badges we have
+#define BADGE_NAME_MAX  (18)                                // Maximum number of chars in badge_t name
+#define LANGUAGE_COUNT  (sizeof(languages) / sizeof(languages[0])) // Number of languages we have
 
 enum clipTypes {
     playOnce,           // Play the clip once and then revert to idle. It's okay to interrupt it with an new clip
@@ -51,61 +98,128 @@ enum clipTypes {
     loop                // Play the clip over and over. It's okay to interrupt it with a new clip
 };
 
+enum pendingPolicies {
+    replacePending,     // A clip requested while this one can't be interrupted replaces any already waiting
+    queuePending        // Clips requested while this one can't be interrupted wait their turn in order
+};
+
 typedef struct clip_t {
     char name[CLIP_NAME_MAX];                               // Name of clip
-    char file[CLIP_FILE_MAX];                               // Filename relative to MEDIAPATH
+    char file[RENDITION_MAX][CLIP_FILE_MAX];                // Filename of each rendition relative to MEDIAPATH; 
+                                                            //   best first. Unused ones are ""
     enum clipTypes type;                                    // Type of clip
+    int guardMs;                                            // Can't be interrupted for this many ms after starting
+    enum pendingPolicies pending;                           // What happens to clips requested while it can't be interrupted
+    int priority;                                           // Requests for clips with higher priority interrupt it regardless
 } clip_t;
 
+typedef struct scrubProxy_t {
+    int clipId;                                             // The clip (index into clips[]) this is a proxy for
+    char file[CLIP_FILE_MAX];                               // Filename relative to MEDIA_PATH
+} scrubProxy_t;
+
+typedef struct sfx_t {
+    char name[SFX_NAME_MAX];                                // Name of the sound effect
+    char file[CLIP_FILE_MAX];                               // Filename relative to MEDIA_PATH
+} sfx_t;
+
+typedef struct badge_t {
+    char name[BADGE_NAME_MAX];                              // Name of the badge
+    char file[CLIP_FILE_MAX];                               // Filename relative to MEDIA_PATH
+} badge_t;
+
+typedef struct language_t {
+    char code[3];                                           // ISO 639-1 code, e.g., "en"
+    char code3[4];                                          // ISO 639-2/T code, e.g., "eng", as used to tag tracks in MP4 files
+    char code3b[4];                                         // ISO 639-2/B code, e.g., "chi", if it's different; else ""
+} language_t;
+
 // The collection clip definitions, indexed by the type sb_clipId_t in Storyboardtypes.h over in
 // the controller program. This needs to match exactly.
 clip_t clips[] = {
-    {"noClip", "dummy.mp4", playOnce},                          //  0
-    {"divingLoop", "divingLoop.mp4", loop},                     //  1
-    {"restingLoop", "restingLoop.mp4", loop},                   //  2
-    {"abandonedClip", "abandonedClip.mp4", loop},               //  3
-    {"instructLoop", "instructLoop.mp4", loop},                 //  4
-    {"fullSite1Clip", "fullSite1Clip.mp4", playOnce},           //  5
-    {"fullSite2Clip", "fullSite2Clip.mp4", playOnce},           //  6
-    {"fullSite3Clip", "fullSite3Clip.mp4", playOnce},           //  7
-    {"fullSite4Clip", "fullSite4Clip.mp4", playOnce},           //  8
-    {"fullSite5Clip", "fullSite5Clip.mp4", playOnce},           //  9
-    {"site1NoCohortsClip", "site1NoCohortsClip.mp4", playOnce}, // 10
-    {"site2NoCohortsClip", "site2NoCohortsClip.mp4", playOnce}, // 11
-    {"site3NoCohortsClip", "site3NoCohortsClip.mp4", playOnce}, // 12
-    {"site4NoCohortsClip", "site4NoCohortsClip.mp4", playOnce}, // 13
-    {"site5NoCohortsClip", "site5NoCohortsClip.mp4", playOnce}, // 14
-    {"openSite1Clip", "openSite1Clip.mp4", playOnce},           // 15
-    {"openSite2Clip", "openSite2Clip.mp4", playOnce},           // 16
-    {"openSite3Clip", "openSite3Clip.mp4", playOnce},           // 17
-    {"openSite4Clip", "openSite4Clip.mp4", playOnce},           // 18
-    {"openSite5Clip", "openSite5Clip.mp4", playOnce},           // 10
-    {"fillSite1Clip", "fillSite1Clip.mp4", fullPlay},           // 20
-    {"fillSite2Clip", "fillSite2Clip.mp4", fullPlay},           // 21
-    {"fillSite3Clip", "fillSite3Clip.mp4", fullPlay},           // 22
-    {"fillSite4Clip", "fillSite4Clip.mp4", fullPlay},           // 23
-    {"fillSite5Clip", "fillSite5Clip.mp4", fullPlay},           // 24
-    {"atSite1Loop", "atSite1Loop.mp4", loop},                   // 25
-    {"atSite2Loop", "atSite2Loop.mp4", loop},                   // 26
-    {"atSite3Loop", "atSite3Loop.mp4", loop},                   // 27
-    {"atSite4Loop", "atSite4Loop.mp4", loop},                   // 28
-    {"atSite5Loop", "atSite5Loop.mp4", loop},                   // 29
-    {"reviewSite1Clip", "reviewSite1Clip.mp4", fullPlay},       // 30
-    {"reviewSite2Clip", "reviewSite2Clip.mp4", fullPlay},       // 31
-    {"reviewSite3Clip", "reviewSite3Clip.mp4", fullPlay},       // 32
-    {"reviewSite4Clip", "reviewSite4Clip.mp4", fullPlay},       // 33
-    {"reviewSite5Clip", "reviewSite5Clip.mp4", fullPlay},       // 34
-    {"outAtSite1Clip", "outAtSite1Clip.mp4", fullPlay},         // 35
-    {"outAtSite2Clip", "outAtSite2Clip.mp4", fullPlay},         // 36
-    {"outAtSite3Clip", "outAtSite3Clip.mp4", fullPlay},         // 37
-    {"outAtSite4Clip", "outAtSite4Clip.mp4", fullPlay},         // 38
-    {"outAtSite5Clip", "outAtSite5Clip.mp4", fullPlay},         // 39
-    {"boatCohortsLoop", "boatCohortsLoop.mp4", loop},           // 40
-    {"atBoatLoopp", "atBoatLoop.mp4", loop},                    // 41
-    {"transitionClip", "transitionClip.mp4", fullPlay},         // 42
-    {"calibrationLoop", "calibrateLoop.mp4", loop},             // 43
-    {"reviewIntroClip", "reviewIntroClip.mp4", fullPlay},       // 44
-    {"superScoreClip", "superScoreClip.mp4", fullPlay},         // 45
-    {"goodScoreClip", "gooScoreClip.mp4", fullPlay},            // 46
-    {"mehScoreClip", "mehScoreClip.mp4", fullPlay}              // 47
-};
\ No newline at end of file
+    {"noClip", {"dummy.mp4"}, playOnce},                            //  0
+    {"divingLoop", {"divingLoop.mp4"}, loop},                       //  1
+    {"restingLoop", {"restingLoop.mp4"}, loop},                     //  2
+    {"abandonedClip", {"abandonedClip.mp4"}, loop},                 //  3
+    {"instructLoop", {"instructLoop.mp4"}, loop},                   //  4
+    {"fullSite1Clip", {"fullSite1Clip.mp4", "fullSite1Clip_720p.mp4", "fullSite1Clip_480p.mp4"}, playOnce}, //  5
+    {"fullSite2Clip", {"fullSite2Clip.mp4", "fullSite2Clip_720p.mp4", "fullSite2Clip_480p.mp4"}, playOnce}, //  6
+    {"fullSite3Clip", {"fullSite3Clip.mp4", "fullSite3Clip_720p.mp4", "fullSite3Clip_480p.mp4"}, playOnce}, //  7
+    {"fullSite4Clip", {"fullSite4Clip.mp4", "fullSite4Clip_720p.mp4", "fullSite4Clip_480p.mp4"}, playOnce}, //  8
+    {"fullSite5Clip", {"fullSite5Clip.mp4", "fullSite5Clip_720p.mp4", "fullSite5Clip_480p.mp4"}, playOnce}, //  9
+    {"site1NoCohortsClip", {"site1NoCohortsClip.mp4"}, playOnce},   // 10
+    {"site2NoCohortsClip", {"site2NoCohortsClip.mp4"}, playOnce},   // 11
+    {"site3NoCohortsClip", {"site3NoCohortsClip.mp4"}, playOnce},   // 12
+    {"site4NoCohortsClip", {"site4NoCohortsClip.mp4"}, playOnce},   // 13
+    {"site5NoCohortsClip", {"site5NoCohortsClip.mp4"}, playOnce},   // 14
+    {"openSite1Clip", {"openSite1Clip.mp4"}, playOnce},             // 15
+    {"openSite2Clip", {"openSite2Clip.mp4"}, playOnce},             // 16
+    {"openSite3Clip", {"openSite3Clip.mp4"}, playOnce},             // 17
+    {"openSite4Clip", {"openSite4Clip.mp4"}, playOnce},             // 18
+    {"openSite5Clip", {"openSite5Clip.mp4"}, playOnce},             // 10
+    {"fillSite1Clip", {"fillSite1Clip.mp4"}, fullPlay},             // 20
+    {"fillSite2Clip", {"fillSite2Clip.mp4"}, fullPlay},             // 21
+    {"fillSite3Clip", {"fillSite3Clip.mp4"}, fullPlay},             // 22
+    {"fillSite4Clip", {"fillSite4Clip.mp4"}, fullPlay},             // 23
+    {"fillSite5Clip", {"fillSite5Clip.mp4"}, fullPlay},             // 24
+    {"atSite1Loop", {"atSite1Loop.mp4"}, loop},                     // 25
+    {"atSite2Loop", {"atSite2Loop.mp4"}, loop},                     // 26
+    {"atSite3Loop", {"atSite3Loop.mp4"}, loop},                     // 27
+    {"atSite4Loop", {"atSite4Loop.mp4"}, loop},                     // 28
+    {"atSite5Loop", {"atSite5Loop.mp4"}, loop},                     // 29
+    {"reviewSite1Clip", {"reviewSite1Clip.mp4"}, fullPlay},         // 30
+    {"reviewSite2Clip", {"reviewSite2Clip.mp4"}, fullPlay},         // 31
+    {"reviewSite3Clip", {"reviewSite3Clip.mp4"}, fullPlay},         // 32
+    {"reviewSite4Clip", {"reviewSite4Clip.mp4"}, fullPlay},         // 33
+    {"reviewSite5Clip", {"reviewSite5Clip.mp4"}, fullPlay},         // 34
+    {"outAtSite1Clip", {"outAtSite1Clip.mp4"}, fullPlay},           // 35
+    {"outAtSite2Clip", {"outAtSite2Clip.mp4"}, fullPlay},           // 36
+    {"outAtSite3Clip", {"outAtSite3Clip.mp4"}, fullPlay},           // 37
+    {"outAtSite4Clip", {"outAtSite4Clip.mp4"}, fullPlay},           // 38
+    {"outAtSite5Clip", {"outAtSite5Clip.mp4"}, fullPlay},           // 39
+    {"boatCohortsLoop", {"boatCohortsLoop.mp4"}, loop},             // 40
+    {"atBoatLoopp", {"atBoatLoop.mp4"}, loop},                      // 41
+    {"transitionClip", {"transitionClip.mp4"}, fullPlay},           // 42
+    {"calibrationLoop", {"calibrateLoop.mp4"}, loop},               // 43
+    {"reviewIntroClip", {"reviewIntroClip.mp4"}, fullPlay},         // 44
+    {"superScoreClip", {"superScoreClip.mp4"}, fullPlay},           // 45
+    {"goodScoreClip", {"gooScoreClip.mp4"}, fullPlay},              // 46
+    {"mehScoreClip", {"mehScoreClip.mp4"}, fullPlay}                // 47
+};
+
+// The keyframe-only proxies used when scrubbing clips
+scrubProxy_t scrubProxies[] = {
+    {5, "fullSite1Proxy.mp4"},
+    {6, "fullSite2Proxy.mp4"},
+    {7, "fullSite3Proxy.mp4"},
+    {8, "fullSite4Proxy.mp4"},
+    {9, "fullSite5Proxy.mp4"}
+};
+
+// The sound effects the controller can play over the current clip with the !sfx command
+sfx_t sfx[] = {
+    {"fill", "fillSfx.wav"},                                    // A site was successfully filled
+    {"superScore", "superScoreSfx.wav"},                        // Score chimes
+    {"goodScore", "goodScoreSfx.wav"},
+    {"mehScore", "mehScoreSfx.wav"}
+};
+
+// The badges the controller can have shown over the video with the !overlay command
+badge_t badges[] = {
+    {"site1", "site1Badge.png"},                                // Site numbers
+    {"site2", "site2Badge.png"},
+    {"site3", "site3Badge.png"},
+    {"site4", "site4Badge.png"},
+    {"site5", "site5Badge.png"},
+    {"superScore", "superScoreBadge.png"},                      // Scores
+    {"goodScore", "goodScoreBadge.png"},
+    {"mehScore", "mehScoreBadge.png"}
+};
+
+// The languages clips' audio tracks can be in, for the !lang command. The first is the default.
+language_t languages[] = {
+    {"en", "eng", ""},                                          // English
+    {"es", "spa", ""},                                          // Spanish
+    {"zh", "zho", "chi"},                                       // Chinese
+    {"ja", "jpn", ""}                                           // Japanese
+};
@@ -0,0 +1,30 @@
+/***
+ * A fake ALSA for testing MediaPlayer without a sound card: just the PCM calls it uses. The 
+ * fake device can't be opened, so MediaPlayer leaves the audio to VLC. See fakes.c.
+ * 
+ ***/
+#ifndef FAKE_ASOUNDLIB_H
+#define FAKE_ASOUNDLIB_H
+
+#include <sys/types.h>
+
+typedef struct _snd_pcm snd_pcm_t;
+typedef long snd_pcm_sframes_t;
+typedef unsigned long snd_pcm_uframes_t;
+typedef enum { SND_PCM_STREAM_PLAYBACK = 0 } snd_pcm_stream_t;
+typedef enum { SND_PCM_FORMAT_S16 = 2 } snd_pcm_format_t;
+typedef enum { SND_PCM_ACCESS_RW_INTERLEAVED = 3 } snd_pcm_access_t;
+
+int snd_pcm_open(snd_pcm_t **pcm, const char *name, snd_pcm_stream_t stream, int mode);
+int snd_pcm_close(snd_pcm_t *pcm);
+int snd_pcm_set_params(snd_pcm_t *pcm, snd_pcm_format_t format, snd_pcm_access_t access, unsigned int channels, 
+    unsigned int rate, int soft_resample, unsigned int latency);
+snd_pcm_sframes_t snd_pcm_writei(snd_pcm_t *pcm, const void *buffer, snd_pcm_uframes_t size);
+int snd_pcm_recover(snd_pcm_t *pcm, int err, int silent);
+int snd_pcm_pause(snd_pcm_t *pcm, int enable);
+int snd_pcm_drop(snd_pcm_t *pcm);
+int snd_pcm_prepare(snd_pcm_t *pcm);
+int snd_pcm_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp);
+const char *snd_strerror(int errnum);
+
+#endif
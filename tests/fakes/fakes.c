@@ -0,0 +1,342 @@
+/***
+ * The fake libVLC, wiringPi and ALSA that MediaPlayer's tests link with. See the headers in
+ * this directory for what they are and aren't.
+ *
+ ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <wiringPi.h>
+#include <alsa/asoundlib.h>
+#include <vlc/vlc.h>
+
+#define FAKE_LOCKS      (4)                         // Number of piLock() keys
+#define FAKE_HANDLERS   (16)                        // Most event handlers a fake player keeps
+#define FAKE_PATH_MAX   (256)                       // Longest media path kept (chars)
+
+struct libvlc_instance_t {
+    int dummy;
+};
+
+struct libvlc_media_t {
+    char path[FAKE_PATH_MAX];                       // What the media was made from
+};
+
+struct libvlc_event_manager_t {
+    int count;                                      // Number of handlers attached
+    libvlc_event_type_t type[FAKE_HANDLERS];        // The event each handler is for
+    libvlc_callback_t callback[FAKE_HANDLERS];      // The handler
+    void *opaque[FAKE_HANDLERS];                    // What to pass it
+};
+
+struct libvlc_media_player_t {
+    libvlc_media_t *media;                          // The media it was last given; NULL if none
+    int plays;                                      // Times told to play
+    bool paused;                                    // Last told to pause
+    bool ended;                                     // Reached the end of its media; playing starts it over
+    float position;                                 // Last told to seek here
+    int audioTrack;                                 // The audio track it was last given
+    libvlc_event_manager_t events;                  // Its event handlers
+};
+
+static libvlc_instance_t instance;
+static pthread_mutex_t locks[FAKE_LOCKS] = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER
+};
+
+// wiringPi
+
+int piThreadCreate(void *(*fn)(void *)) {
+    pthread_t t;
+    if (pthread_create(&t, NULL, fn, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(t);
+    return 0;
+}
+
+void piLock(int key) {
+    pthread_mutex_lock(&locks[key]);
+}
+
+void piUnlock(int key) {
+    pthread_mutex_unlock(&locks[key]);
+}
+
+// ALSA
+
+int snd_pcm_open(snd_pcm_t **pcm, const char *name, snd_pcm_stream_t stream, int mode) {
+    *pcm = NULL;
+    return -1;
+}
+
+int snd_pcm_close(snd_pcm_t *pcm) {
+    return 0;
+}
+
+int snd_pcm_set_params(snd_pcm_t *pcm, snd_pcm_format_t format, snd_pcm_access_t access, unsigned int channels,
+    unsigned int rate, int soft_resample, unsigned int latency) {
+    return -1;
+}
+
+snd_pcm_sframes_t snd_pcm_writei(snd_pcm_t *pcm, const void *buffer, snd_pcm_uframes_t size) {
+    return size;
+}
+
+int snd_pcm_recover(snd_pcm_t *pcm, int err, int silent) {
+    return 0;
+}
+
+int snd_pcm_pause(snd_pcm_t *pcm, int enable) {
+    return 0;
+}
+
+int snd_pcm_drop(snd_pcm_t *pcm) {
+    return 0;
+}
+
+int snd_pcm_prepare(snd_pcm_t *pcm) {
+    return 0;
+}
+
+int snd_pcm_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp) {
+    *delayp = 0;
+    return 0;
+}
+
+const char *snd_strerror(int errnum) {
+    return "no sound card (fake ALSA)";
+}
+
+// libVLC: instance and log
+
+libvlc_instance_t *libvlc_new(int argc, const char *const *argv) {
+    return &instance;
+}
+
+void libvlc_release(libvlc_instance_t *p_instance) {
+}
+
+void libvlc_log_set(libvlc_instance_t *p_instance, libvlc_log_cb cb, void *data) {
+}
+
+void libvlc_log_unset(libvlc_instance_t *p_instance) {
+}
+
+int64_t libvlc_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+void libvlc_log_get_context(const libvlc_log_t *ctx, const char **module, const char **file, unsigned *line) {
+    *module = "fake";
+    *file = NULL;
+    *line = 0;
+}
+
+// libVLC: media
+
+libvlc_media_t *libvlc_media_new_path(libvlc_instance_t *p_instance, const char *path) {
+    libvlc_media_t *md = calloc(1, sizeof(libvlc_media_t));
+    if (md != NULL) {
+        snprintf(md->path, sizeof(md->path), "%s", path);
+    }
+    return md;
+}
+
+libvlc_media_t *libvlc_media_new_callbacks(libvlc_instance_t *p_instance, libvlc_media_open_cb open_cb,
+    libvlc_media_read_cb read_cb, libvlc_media_seek_cb seek_cb, libvlc_media_close_cb close_cb, void *opaque) {
+    return libvlc_media_new_path(p_instance, "callbacks");
+}
+
+void libvlc_media_add_option(libvlc_media_t *p_md, const char *psz_options) {
+}
+
+libvlc_media_t *libvlc_media_duplicate(libvlc_media_t *p_md) {
+    return libvlc_media_new_path(&instance, p_md->path);
+}
+
+void libvlc_media_release(libvlc_media_t *p_md) {
+    free(p_md);
+}
+
+int libvlc_media_get_stats(libvlc_media_t *p_md, libvlc_media_stats_t *p_stats) {
+    memset(p_stats, 0, sizeof(*p_stats));
+    return 1;
+}
+
+unsigned libvlc_media_tracks_get(libvlc_media_t *p_md, libvlc_media_track_t ***tracks) {
+    *tracks = NULL;
+    return 0;
+}
+
+void libvlc_media_tracks_release(libvlc_media_track_t **p_tracks, unsigned i_count) {
+}
+
+libvlc_media_parsed_status_t libvlc_media_get_parsed_status(libvlc_media_t *p_md) {
+    return libvlc_media_parsed_status_done;
+}
+
+int libvlc_media_parse_with_options(libvlc_media_t *p_md, libvlc_media_parse_flag_t parse_flag, int timeout) {
+    return 0;
+}
+
+// libVLC: media player
+
+libvlc_media_player_t *libvlc_media_player_new(libvlc_instance_t *p_libvlc_instance) {
+    return calloc(1, sizeof(libvlc_media_player_t));
+}
+
+libvlc_media_player_t *libvlc_media_player_new_from_media(libvlc_media_t *p_md) {
+    libvlc_media_player_t *mi = libvlc_media_player_new(&instance);
+    if (mi != NULL) {
+        mi->media = p_md;
+    }
+    return mi;
+}
+
+void libvlc_media_player_release(libvlc_media_player_t *p_mi) {
+    free(p_mi);
+}
+
+void libvlc_media_player_set_media(libvlc_media_player_t *p_mi, libvlc_media_t *p_md) {
+    p_mi->media = p_md;
+    p_mi->ended = false;
+    p_mi->position = 0.0;
+}
+
+libvlc_media_t *libvlc_media_player_get_media(libvlc_media_player_t *p_mi) {
+    return p_mi->media;
+}
+
+libvlc_event_manager_t *libvlc_media_player_event_manager(libvlc_media_player_t *p_mi) {
+    return &p_mi->events;
+}
+
+int libvlc_media_player_play(libvlc_media_player_t *p_mi) {
+    p_mi->plays++;
+    p_mi->paused = false;
+    if (p_mi->ended) {
+        p_mi->ended = false;
+        p_mi->position = 0.0;
+    }
+    return 0;
+}
+
+void libvlc_media_player_set_pause(libvlc_media_player_t *p_mi, int do_pause) {
+    p_mi->paused = do_pause != 0;
+}
+
+void libvlc_media_player_pause(libvlc_media_player_t *p_mi) {
+    p_mi->paused = !p_mi->paused;
+}
+
+int libvlc_media_player_is_playing(libvlc_media_player_t *p_mi) {
+    return p_mi->plays > 0 && !p_mi->paused;
+}
+
+void libvlc_media_player_stop(libvlc_media_player_t *p_mi) {
+    p_mi->paused = false;
+    p_mi->ended = false;
+    p_mi->position = 0.0;
+}
+
+void libvlc_media_player_set_position(libvlc_media_player_t *p_mi, float f_pos) {
+    p_mi->position = f_pos;
+}
+
+void libvlc_media_player_set_xwindow(libvlc_media_player_t *p_mi, uint32_t drawable) {
+}
+
+void libvlc_set_fullscreen(libvlc_media_player_t *p_mi, int b_fullscreen) {
+}
+
+int libvlc_event_attach(libvlc_event_manager_t *p_event_manager, libvlc_event_type_t i_event_type,
+    libvlc_callback_t f_callback, void *user_data) {
+    if (p_event_manager->count == FAKE_HANDLERS) {
+        return -1;
+    }
+    p_event_manager->type[p_event_manager->count] = i_event_type;
+    p_event_manager->callback[p_event_manager->count] = f_callback;
+    p_event_manager->opaque[p_event_manager->count] = user_data;
+    p_event_manager->count++;
+    return 0;
+}
+
+// libVLC: video and audio
+
+void libvlc_video_set_callbacks(libvlc_media_player_t *mp, libvlc_video_lock_cb lock,
+    libvlc_video_unlock_cb unlock, libvlc_video_display_cb display, void *opaque) {
+}
+
+void libvlc_video_set_format(libvlc_media_player_t *mp, const char *chroma, unsigned width, unsigned height,
+    unsigned pitch) {
+}
+
+void libvlc_video_set_marquee_int(libvlc_media_player_t *p_mi, unsigned option, int i_val) {
+}
+
+void libvlc_video_set_marquee_string(libvlc_media_player_t *p_mi, unsigned option, const char *psz_text) {
+}
+
+void libvlc_video_set_logo_int(libvlc_media_player_t *p_mi, unsigned option, int value) {
+}
+
+void libvlc_video_set_logo_string(libvlc_media_player_t *p_mi, unsigned option, const char *psz_value) {
+}
+
+void libvlc_audio_set_callbacks(libvlc_media_player_t *mp, libvlc_audio_play_cb play, libvlc_audio_pause_cb pause,
+    libvlc_audio_resume_cb resume, libvlc_audio_flush_cb flush, libvlc_audio_drain_cb drain, void *opaque) {
+}
+
+int libvlc_audio_set_format(libvlc_media_player_t *mp, const char *format, unsigned rate, unsigned channels) {
+    return 0;
+}
+
+int libvlc_audio_get_track(libvlc_media_player_t *p_mi) {
+    return p_mi->audioTrack;
+}
+
+int libvlc_audio_set_track(libvlc_media_player_t *p_mi, int i_track) {
+    p_mi->audioTrack = i_track;
+    return 0;
+}
+
+// Fake-only
+
+const char *fakeMediaPath(libvlc_media_t *p_md) {
+    return p_md == NULL ? "" : p_md->path;
+}
+
+int fakePlayCount(libvlc_media_player_t *p_mi) {
+    return p_mi->plays;
+}
+
+bool fakeIsPaused(libvlc_media_player_t *p_mi) {
+    return p_mi->paused;
+}
+
+float fakePosition(libvlc_media_player_t *p_mi) {
+    return p_mi->position;
+}
+
+void fakeFireEvent(libvlc_media_player_t *p_mi, libvlc_event_type_t i_event_type) {
+    libvlc_event_t e;
+    memset(&e, 0, sizeof(e));
+    e.type = i_event_type;
+    e.p_obj = p_mi;
+    if (i_event_type == libvlc_MediaPlayerPositionChanged) {
+        e.u.media_player_position_changed.new_position = p_mi->position;    // The seek has shown up
+    } else if (i_event_type == libvlc_MediaPlayerEndReached) {
+        p_mi->ended = true;                                             // Ended, which isn't paused
+        p_mi->paused = false;
+    }
+    for (int i = 0; i < p_mi->events.count; i++) {
+        if (p_mi->events.type[i] == i_event_type) {
+            p_mi->events.callback[i](&e, p_mi->events.opaque[i]);
+        }
+    }
+}
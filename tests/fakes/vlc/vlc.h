@@ -0,0 +1,215 @@
+/***
+ * A fake libVLC for testing MediaPlayer without VLC, a display or media files.
+ * 
+ * It declares just the parts of the libVLC 3 API that MediaPlayer uses, with
+ * the same names and types, so MediaPlayer.c compiles against it unchanged.
+ * The implementations, in fakes.c, don't decode anything: a media item is its
+ * path, and a media player remembers the media it was given, whether it was
+ * told to play, pause or stop and where it was told to seek. A test can look
+ * at that and can fire player events at MediaPlayer's handlers with
+ * fakeFireEvent(). A position change reports where the player was last told
+ * to seek; the end of the media means the next play starts it over from the
+ * beginning.
+ * 
+ ***/
+#ifndef FAKE_VLC_H
+#define FAKE_VLC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <sys/types.h>
+
+typedef struct libvlc_instance_t libvlc_instance_t;
+typedef struct libvlc_media_t libvlc_media_t;
+typedef struct libvlc_media_player_t libvlc_media_player_t;
+typedef struct libvlc_event_manager_t libvlc_event_manager_t;
+typedef struct vlc_log_t libvlc_log_t;
+typedef int libvlc_event_type_t;
+
+enum libvlc_log_level {
+    LIBVLC_DEBUG = 0,
+    LIBVLC_NOTICE = 2,
+    LIBVLC_WARNING = 3,
+    LIBVLC_ERROR = 4
+};
+
+enum libvlc_event_e {
+    libvlc_MediaPlayerPlaying = 0x104,
+    libvlc_MediaPlayerPaused,
+    libvlc_MediaPlayerStopped,
+    libvlc_MediaPlayerEndReached = 0x109,
+    libvlc_MediaPlayerEncounteredError,
+    libvlc_MediaPlayerPositionChanged = 0x10c,
+    libvlc_MediaPlayerVout = 0x112,
+    libvlc_MediaPlayerESAdded = 0x114,
+    libvlc_MediaPlayerESSelected = 0x116
+};
+
+typedef enum libvlc_track_type_t {
+    libvlc_track_unknown = -1,
+    libvlc_track_audio = 0,
+    libvlc_track_video = 1,
+    libvlc_track_text = 2
+} libvlc_track_type_t;
+
+typedef struct libvlc_event_t {
+    int type;
+    void *p_obj;
+    union {
+        struct {
+            libvlc_track_type_t i_type;
+            int i_id;
+        } media_player_es_changed;
+        struct {
+            int new_count;
+        } media_player_vout;
+        struct {
+            float new_position;
+        } media_player_position_changed;
+    } u;
+} libvlc_event_t;
+
+typedef struct libvlc_media_stats_t {
+    int i_read_bytes;
+    float f_input_bitrate;
+    int i_demux_read_bytes;
+    float f_demux_bitrate;
+    int i_demux_corrupted;
+    int i_demux_discontinuity;
+    int i_decoded_video;
+    int i_decoded_audio;
+    int i_displayed_pictures;
+    int i_lost_pictures;
+    int i_played_abuffers;
+    int i_lost_abuffers;
+    int i_sent_packets;
+    int i_sent_bytes;
+    float f_send_bitrate;
+} libvlc_media_stats_t;
+
+typedef struct libvlc_media_track_t {
+    uint32_t i_codec;
+    uint32_t i_original_fourcc;
+    int i_id;
+    libvlc_track_type_t i_type;
+    int i_profile;
+    int i_level;
+    void *audio;
+    unsigned int i_bitrate;
+    char *psz_language;
+    char *psz_description;
+} libvlc_media_track_t;
+
+typedef enum libvlc_media_parse_flag_t {
+    libvlc_media_parse_local = 0
+} libvlc_media_parse_flag_t;
+
+typedef enum libvlc_media_parsed_status_t {
+    libvlc_media_parsed_status_skipped = 1,
+    libvlc_media_parsed_status_failed,
+    libvlc_media_parsed_status_timeout,
+    libvlc_media_parsed_status_done
+} libvlc_media_parsed_status_t;
+
+enum libvlc_video_marquee_option_t {
+    libvlc_marquee_Enable = 0,
+    libvlc_marquee_Text,
+    libvlc_marquee_Color,
+    libvlc_marquee_Opacity,
+    libvlc_marquee_Position,
+    libvlc_marquee_Refresh,
+    libvlc_marquee_Size,
+    libvlc_marquee_Timeout,
+    libvlc_marquee_X,
+    libvlc_marquee_Y
+};
+
+enum libvlc_video_logo_option_t {
+    libvlc_logo_enable,
+    libvlc_logo_file,
+    libvlc_logo_x,
+    libvlc_logo_y,
+    libvlc_logo_delay,
+    libvlc_logo_repeat,
+    libvlc_logo_opacity,
+    libvlc_logo_position
+};
+
+typedef void (*libvlc_callback_t)(const struct libvlc_event_t *p_event, void *p_data);
+typedef int (*libvlc_media_open_cb)(void *opaque, void **datap, uint64_t *sizep);
+typedef ssize_t (*libvlc_media_read_cb)(void *opaque, unsigned char *buf, size_t len);
+typedef int (*libvlc_media_seek_cb)(void *opaque, uint64_t offset);
+typedef void (*libvlc_media_close_cb)(void *opaque);
+typedef void (*libvlc_log_cb)(void *data, int level, const libvlc_log_t *ctx, const char *fmt, va_list args);
+typedef void *(*libvlc_video_lock_cb)(void *opaque, void **planes);
+typedef void (*libvlc_video_unlock_cb)(void *opaque, void *picture, void *const *planes);
+typedef void (*libvlc_video_display_cb)(void *opaque, void *picture);
+typedef void (*libvlc_audio_play_cb)(void *data, const void *samples, unsigned count, int64_t pts);
+typedef void (*libvlc_audio_pause_cb)(void *data, int64_t pts);
+typedef void (*libvlc_audio_resume_cb)(void *data, int64_t pts);
+typedef void (*libvlc_audio_flush_cb)(void *data, int64_t pts);
+typedef void (*libvlc_audio_drain_cb)(void *data);
+
+// Instance and log
+libvlc_instance_t *libvlc_new(int argc, const char *const *argv);
+void libvlc_release(libvlc_instance_t *p_instance);
+int64_t libvlc_clock(void);
+void libvlc_log_set(libvlc_instance_t *p_instance, libvlc_log_cb cb, void *data);
+void libvlc_log_unset(libvlc_instance_t *p_instance);
+void libvlc_log_get_context(const libvlc_log_t *ctx, const char **module, const char **file, unsigned *line);
+
+// Media
+libvlc_media_t *libvlc_media_new_path(libvlc_instance_t *p_instance, const char *path);
+libvlc_media_t *libvlc_media_new_callbacks(libvlc_instance_t *p_instance, libvlc_media_open_cb open_cb, 
+    libvlc_media_read_cb read_cb, libvlc_media_seek_cb seek_cb, libvlc_media_close_cb close_cb, void *opaque);
+void libvlc_media_add_option(libvlc_media_t *p_md, const char *psz_options);
+libvlc_media_t *libvlc_media_duplicate(libvlc_media_t *p_md);
+void libvlc_media_release(libvlc_media_t *p_md);
+int libvlc_media_get_stats(libvlc_media_t *p_md, libvlc_media_stats_t *p_stats);
+unsigned libvlc_media_tracks_get(libvlc_media_t *p_md, libvlc_media_track_t ***tracks);
+void libvlc_media_tracks_release(libvlc_media_track_t **p_tracks, unsigned i_count);
+libvlc_media_parsed_status_t libvlc_media_get_parsed_status(libvlc_media_t *p_md);
+int libvlc_media_parse_with_options(libvlc_media_t *p_md, libvlc_media_parse_flag_t parse_flag, int timeout);
+
+// Media player
+libvlc_media_player_t *libvlc_media_player_new(libvlc_instance_t *p_libvlc_instance);
+libvlc_media_player_t *libvlc_media_player_new_from_media(libvlc_media_t *p_md);
+void libvlc_media_player_release(libvlc_media_player_t *p_mi);
+void libvlc_media_player_set_media(libvlc_media_player_t *p_mi, libvlc_media_t *p_md);
+libvlc_media_t *libvlc_media_player_get_media(libvlc_media_player_t *p_mi);
+libvlc_event_manager_t *libvlc_media_player_event_manager(libvlc_media_player_t *p_mi);
+int libvlc_media_player_play(libvlc_media_player_t *p_mi);
+void libvlc_media_player_set_pause(libvlc_media_player_t *p_mi, int do_pause);
+void libvlc_media_player_pause(libvlc_media_player_t *p_mi);
+int libvlc_media_player_is_playing(libvlc_media_player_t *p_mi);
+void libvlc_media_player_stop(libvlc_media_player_t *p_mi);
+void libvlc_media_player_set_position(libvlc_media_player_t *p_mi, float f_pos);
+void libvlc_media_player_set_xwindow(libvlc_media_player_t *p_mi, uint32_t drawable);
+void libvlc_set_fullscreen(libvlc_media_player_t *p_mi, int b_fullscreen);
+int libvlc_event_attach(libvlc_event_manager_t *p_event_manager, libvlc_event_type_t i_event_type, 
+    libvlc_callback_t f_callback, void *user_data);
+
+// Video and audio
+void libvlc_video_set_callbacks(libvlc_media_player_t *mp, libvlc_video_lock_cb lock, 
+    libvlc_video_unlock_cb unlock, libvlc_video_display_cb display, void *opaque);
+void libvlc_video_set_format(libvlc_media_player_t *mp, const char *chroma, unsigned width, unsigned height, 
+    unsigned pitch);
+void libvlc_video_set_marquee_int(libvlc_media_player_t *p_mi, unsigned option, int i_val);
+void libvlc_video_set_marquee_string(libvlc_media_player_t *p_mi, unsigned option, const char *psz_text);
+void libvlc_video_set_logo_int(libvlc_media_player_t *p_mi, unsigned option, int value);
+void libvlc_video_set_logo_string(libvlc_media_player_t *p_mi, unsigned option, const char *psz_value);
+void libvlc_audio_set_callbacks(libvlc_media_player_t *mp, libvlc_audio_play_cb play, libvlc_audio_pause_cb pause, 
+    libvlc_audio_resume_cb resume, libvlc_audio_flush_cb flush, libvlc_audio_drain_cb drain, void *opaque);
+int libvlc_audio_set_format(libvlc_media_player_t *mp, const char *format, unsigned rate, unsigned channels);
+int libvlc_audio_get_track(libvlc_media_player_t *p_mi);
+int libvlc_audio_set_track(libvlc_media_player_t *p_mi, int i_track);
+
+// Fake-only: what a test can look at and do
+const char *fakeMediaPath(libvlc_media_t *p_md);                    // The path media p_md was made from; "" if none
+int fakePlayCount(libvlc_media_player_t *p_mi);                     // Times p_mi has been told to play
+bool fakeIsPaused(libvlc_media_player_t *p_mi);                     // Whether p_mi was last told to pause
+float fakePosition(libvlc_media_player_t *p_mi);                    // Where p_mi was last told to seek; 0 if it's started over
+void fakeFireEvent(libvlc_media_player_t *p_mi, libvlc_event_type_t i_event_type);  // Call p_mi's handlers for an event
+
+#endif
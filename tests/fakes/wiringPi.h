@@ -0,0 +1,15 @@
+/***
+ * A fake wiringPi for testing MediaPlayer off the Pi: just the threads and locks it uses, on
+ * top of pthreads. See fakes.c.
+ * 
+ ***/
+#ifndef FAKE_WIRINGPI_H
+#define FAKE_WIRINGPI_H
+
+#define PI_THREAD(X) void *X (void *dummy)
+
+int piThreadCreate(void *(*fn)(void *));
+void piLock(int key);
+void piUnlock(int key);
+
+#endif
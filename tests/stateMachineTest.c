@@ -0,0 +1,331 @@
+/***
+ * Table test for MediaPlayer's main loop state machine.
+ *
+ * Builds MediaPlayer.c against the fake libVLC, wiringPi and ALSA in fakes/
+ * and, for each case in cases[], starts main loop's state machine afresh and
+ * runs it through the steps given: controller commands (through the same
+ * command handlers the controller thread uses), libVLC player events (fired
+ * at MediaPlayer's own handlers by the fake player) and timers coming due.
+ * After each step it checks the state main loop is in and the clip it's
+ * playing, and that the fake player was given that clip's media. Steps that
+ * just check also look at whether the player is being held paused where the
+ * dial says and at what MediaPlayer has sent the controller.
+ *
+ * "make test" in this directory builds and runs it. Exits 0 if every case
+ * passes, 1 otherwise.
+ *
+ ***/
+#define main mediaPlayerMain
+#include "../MediaPlayer.c"
+#undef main
+
+#define STEPS_MAX       (16)                        // Most steps in a case
+
+// The clips the cases use, and how they're set up for the test
+#define LOOP_A          (1)                         // divingLoop
+#define LOOP_B          (2)                         // restingLoop
+#define GUARD_REPLACE   (10)                        // Guarded; a request while guarded replaces any waiting
+#define GUARD_QUEUE     (11)                        // Guarded; requests while guarded queue up
+#define HIGH_PRIORITY   (12)                        // Priority 1; interrupts anything
+#define PLAIN_A         (13)                        // Plain playOnce clips
+#define PLAIN_B         (14)
+#define FULL_PLAY       (20)                        // fillSite1Clip; fullPlay
+#define SCRUBBED_A      (5)                         // Clips scrubbed
+#define SCRUBBED_B      (6)
+#define TEST_GUARD_MS   (60000)                     // Long enough that only the test ends a guard
+
+enum stepKinds {
+    skEnd,                                          // No more steps
+    skCommand,                                      // A controller command line
+    skVlcEvent,                                     // A libVLC event from the player
+    skTimer,                                        // A main loop timer coming due
+    skHeld,                                         // Nothing; check the player is paused at a position
+    skSent                                          // Nothing; check a line was sent to the controller
+};
+
+typedef struct step_t {
+    enum stepKinds kind;                            // What happens
+    const char *command;                            // skCommand: the command line
+    int event;                                      // skVlcEvent: the libVLC event; skTimer: the timer's event
+    enum playerStates state;                        // The state main loop should then be in
+    int clipId;                                     // The clip it should then be playing
+    int permille;                                   // skHeld: the position it should be paused at (per mille)
+    const char *sent;                               // skSent: what should have been sent since the last skSent
+} step_t;
+
+typedef struct case_t {
+    const char *name;                               // What the case is about
+    step_t step[STEPS_MAX];                         // What happens, in order
+} case_t;
+
+#define CMD(line, st, id)   {skCommand, line, 0, st, id}
+#define VLC(ev, st, id)     {skVlcEvent, NULL, ev, st, id}
+#define TIMER(ev, st, id)   {skTimer, NULL, ev, st, id}
+#define HELD(id, pm)        {skHeld, NULL, 0, stScrubbing, id, pm}
+#define SENT(st, id, line)  {skSent, NULL, 0, st, id, 0, line}
+#define END                 libvlc_MediaPlayerEndReached
+#define POS                 libvlc_MediaPlayerPositionChanged
+
+case_t cases[] = {
+    {"loop, play and return to loop", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!playClip 13", stPlaying, PLAIN_A),
+        CMD("!setLoop 2", stPlaying, PLAIN_A),
+        VLC(END, stLooping, LOOP_B),
+        CMD("!playClip 0", stLooping, LOOP_B)}},
+    {"interruptible clips are replaced", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!playClip 13", stPlaying, PLAIN_A),
+        CMD("!playClip 14", stPlaying, PLAIN_B),
+        CMD("!playClip 0", stLooping, LOOP_A)}},
+    {"replacePending: the latest request waits out the guard", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!playClip 10", stGuarded, GUARD_REPLACE),
+        CMD("!playClip 13", stGuarded, GUARD_REPLACE),
+        CMD("!playClip 14", stGuarded, GUARD_REPLACE),
+        TIMER(evGuardExpired, stPlaying, PLAIN_B),
+        VLC(END, stLooping, LOOP_A)}},
+    {"queuePending: requests wait their turn in order", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!playClip 11", stGuarded, GUARD_QUEUE),
+        CMD("!playClip 13", stGuarded, GUARD_QUEUE),
+        CMD("!playClip 14", stGuarded, GUARD_QUEUE),
+        TIMER(evGuardExpired, stPlaying, PLAIN_A),
+        VLC(END, stPlaying, PLAIN_B),
+        VLC(END, stLooping, LOOP_A)}},
+    {"guard: clip 0 cancels what's waiting; clip plays on after the guard", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!playClip 10", stGuarded, GUARD_REPLACE),
+        CMD("!playClip 13", stGuarded, GUARD_REPLACE),
+        CMD("!playClip 0", stGuarded, GUARD_REPLACE),
+        TIMER(evGuardExpired, stPlaying, GUARD_REPLACE),
+        VLC(END, stLooping, LOOP_A)}},
+    {"guard: a guarded clip that ends starts what's waiting", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!playClip 10", stGuarded, GUARD_REPLACE),
+        CMD("!playClip 13", stGuarded, GUARD_REPLACE),
+        VLC(END, stPlaying, PLAIN_A),
+        VLC(END, stLooping, LOOP_A)}},
+    {"fullPlay: locked until it ends", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!playClip 20", stLocked, FULL_PLAY),
+        CMD("!playClip 13", stLocked, FULL_PLAY),
+        CMD("!setLoop 2", stLocked, FULL_PLAY),
+        VLC(END, stPlaying, PLAIN_A),
+        VLC(END, stLooping, LOOP_B)}},
+    {"priority: interrupts fullPlay and guarded clips", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!playClip 20", stLocked, FULL_PLAY),
+        CMD("!playClip 12", stPlaying, HIGH_PRIORITY),
+        CMD("!playClip 10", stGuarded, GUARD_REPLACE),
+        CMD("!playClip 12", stPlaying, HIGH_PRIORITY),
+        VLC(END, stLooping, LOOP_A)}},
+    {"scrub: takes over, holds, and ends when the dial goes idle", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!scrub 5 500", stScrubbing, SCRUBBED_A),
+        VLC(libvlc_MediaPlayerPlaying, stScrubbing, SCRUBBED_A),
+        HELD(SCRUBBED_A, 500),
+        CMD("!scrub 5 600", stScrubbing, SCRUBBED_A),
+        VLC(POS, stScrubbing, SCRUBBED_A),
+        TIMER(evSeekDue, stScrubbing, SCRUBBED_A),
+        HELD(SCRUBBED_A, 600),
+        CMD("!scrub 6 100", stScrubbing, SCRUBBED_B),
+        VLC(libvlc_MediaPlayerPlaying, stScrubbing, SCRUBBED_B),
+        HELD(SCRUBBED_B, 100),
+        TIMER(evScrubIdle, stLooping, LOOP_A)}},
+    {"scrub: kept off the end, and started again held if a seek ends it", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!scrub 5 1000", stScrubbing, SCRUBBED_A),
+        VLC(libvlc_MediaPlayerPlaying, stScrubbing, SCRUBBED_A),
+        HELD(SCRUBBED_A, 995),
+        VLC(END, stScrubbing, SCRUBBED_A),
+        VLC(libvlc_MediaPlayerPlaying, stScrubbing, SCRUBBED_A),
+        TIMER(evSeekDue, stScrubbing, SCRUBBED_A),
+        HELD(SCRUBBED_A, 995),
+        TIMER(evScrubIdle, stLooping, LOOP_A)}},
+    {"scrub: a clip it interrupts is reported ended", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!playClip 13", stPlaying, PLAIN_A),
+        CMD("!scrub 5 500", stScrubbing, SCRUBBED_A),
+        SENT(stScrubbing, SCRUBBED_A, "!videoEnds\n"),
+        TIMER(evScrubIdle, stLooping, LOOP_A),
+        SENT(stLooping, LOOP_A, "!videoEnds\n")}},
+    {"scrub: a clip request ends it", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!scrub 5 500", stScrubbing, SCRUBBED_A),
+        CMD("!playClip 13", stPlaying, PLAIN_A),
+        VLC(END, stLooping, LOOP_A)}},
+    {"scrub: dropped while locked, and works again after", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!playClip 20", stLocked, FULL_PLAY),
+        CMD("!scrub 5 500", stLocked, FULL_PLAY),
+        CMD("!scrub 5 600", stLocked, FULL_PLAY),
+        VLC(END, stLooping, LOOP_A),
+        CMD("!scrub 5 700", stScrubbing, SCRUBBED_A)}},
+    {"scrub: dropped while guarded, and works again after", {
+        CMD("!setLoop 1", stLooping, LOOP_A),
+        CMD("!playClip 10", stGuarded, GUARD_REPLACE),
+        CMD("!scrub 6 500", stGuarded, GUARD_REPLACE),
+        TIMER(evGuardExpired, stPlaying, GUARD_REPLACE),
+        CMD("!scrub 6 600", stScrubbing, SCRUBBED_B)}}
+};
+
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+char *ctlText = NULL;                               // Everything sent to the controller (ctlOut)
+size_t ctlSize = 0;                                 // Its length
+size_t ctlSeen = 0;                                 // How much of it skSent steps have looked at
+
+/***
+ *
+ * resetMachine     Put main loop's state machine back the way it is at startup
+ *
+ ***/
+void resetMachine() {
+    pthread_mutex_lock(&eventLock);
+    eventCount = 0;
+    memset(timerAt, 0, sizeof(timerAt));
+    pthread_mutex_unlock(&eventLock);
+    piLock(LOCK_SCRUB);
+    scrubPending = false;
+    piUnlock(LOCK_SCRUB);
+    playerState = stWaiting;
+    nowPlayingId = 0;
+    reqLoopId = 0;
+    pendingCount = 0;
+    guardUntilMicros = 0;
+    scrubHasTarget = false;
+    scrubNeedsHold = false;
+    seekInFlight = false;
+    libvlc_media_player_stop(mp);
+    fflush(ctlOut);
+    ctlSeen = ctlSize;
+}
+
+/***
+ *
+ * runQueued    Have main loop handle every event that's waiting or timer that's due, without
+ *              sleeping for any that aren't
+ *
+ ***/
+void runQueued() {
+    while (true) {
+        bool ready;
+        pthread_mutex_lock(&eventLock);
+        ready = eventCount > 0;
+        for (int t = 0; t < EVENT_COUNT && !ready; t++) {
+            ready = timerAt[t] != 0 && timerAt[t] <= microsNow();
+        }
+        pthread_mutex_unlock(&eventLock);
+        if (!ready) {
+            return;
+        }
+        playerEvent_t e;
+        nextEvent(&e);
+        dispatch(&e);
+    }
+}
+
+/***
+ *
+ * runStep      Make step s happen and have main loop deal with it
+ *
+ ***/
+void runStep(const step_t *s) {
+    char line[MAX_LINE_LENGTH];
+    switch (s->kind) {
+        case skCommand:
+            snprintf(line, sizeof(line), "%s", s->command);
+            doCommand(line, controllerRegistry);
+            break;
+        case skVlcEvent:
+            fakeFireEvent(mp, s->event);
+            break;
+        case skTimer:
+            if (s->event == evGuardExpired) {
+                guardUntilMicros = 0;                           // It's over as far as stateForClip() is concerned
+            } else if (s->event == evSeekDue) {
+                seekIssuedMicros = 0;                           // Long enough ago as far as actSeek() is concerned
+            }
+            setTimer(s->event, 1);                              // Due long ago
+            break;
+        case skHeld:
+        case skSent:
+        case skEnd:
+            break;
+    }
+    runQueued();
+}
+
+/***
+ *
+ * checkStep    Whether main loop is where step s says it should be. If not, say how not.
+ *
+ ***/
+bool checkStep(const step_t *s) {
+    static const char *stateName[STATE_COUNT] = {"waiting", "looping", "playing", "guarded", "locked", "scrubbing"};
+    bool ok = true;
+    if (playerState != s->state) {
+        printf("    expected state %s, got %s\n", stateName[s->state], stateName[playerState]);
+        ok = false;
+    }
+    if (nowPlayingId != s->clipId) {
+        printf("    expected clip %d, got %d\n", s->clipId, nowPlayingId);
+        ok = false;
+    }
+    const char *path = fakeMediaPath(libvlc_media_player_get_media(mp));
+    if (s->clipId != 0 && strcmp(path, fakeMediaPath(m[s->clipId][0])) != 0) {
+        printf("    expected the player to have clip %d's media, got \"%s\"\n", s->clipId, path);
+        ok = false;
+    }
+    if (s->kind == skHeld && !fakeIsPaused(mp)) {
+        puts("    expected the player to be paused");
+        ok = false;
+    }
+    if (s->kind == skHeld && fabsf(fakePosition(mp) - s->permille / 1000.0) > 0.0005) {
+        printf("    expected the player at position %.3f, got %.3f\n", s->permille / 1000.0, fakePosition(mp));
+        ok = false;
+    }
+    if (s->kind == skSent) {
+        fflush(ctlOut);
+        if (strstr(ctlText + ctlSeen, s->sent) == NULL) {
+            printf("    expected \"%.*s\" sent to the controller, got \"%s\"\n", (int)strcspn(s->sent, "\n"), s->sent, 
+                ctlText + ctlSeen);
+            ok = false;
+        }
+        ctlSeen = ctlSize;
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    clips[GUARD_REPLACE].guardMs = TEST_GUARD_MS;
+    clips[GUARD_REPLACE].pending = replacePending;
+    clips[GUARD_QUEUE].guardMs = TEST_GUARD_MS;
+    clips[GUARD_QUEUE].pending = queuePending;
+    clips[HIGH_PRIORITY].priority = 1;
+
+    inst = libvlc_new(0, NULL);
+    for (int cNo = 0; cNo < CLIP_COUNT; cNo++) {
+        m[cNo][0] = libvlc_media_new_path(inst, clips[cNo].file[0]);
+    }
+    mp = libvlc_media_player_new(inst);
+    attachPlayerEvents(mp, 0);
+    ctlOut = open_memstream(&ctlText, &ctlSize);        // Stands in for the link to the controller
+
+    int failed = 0;
+    for (int cNo = 0; cNo < CASE_COUNT; cNo++) {
+        printf("Case %d: %s\n", cNo, cases[cNo].name);
+        resetMachine();
+        for (int sNo = 0; sNo < STEPS_MAX && cases[cNo].step[sNo].kind != skEnd; sNo++) {
+            runStep(&cases[cNo].step[sNo]);
+            if (!checkStep(&cases[cNo].step[sNo])) {
+                printf("  FAIL at step %d\n", sNo);
+                failed++;
+                break;
+            }
+        }
+    }
+    printf("%d of %d cases passed.\n", (int)CASE_COUNT - failed, (int)CASE_COUNT);
+    return failed == 0 ? 0 : 1;
+}